@@ -0,0 +1,277 @@
+#include <autotuner.hpp>
+#include <barnes_hut_tree.hpp>
+#include <particle_mesh.hpp>
+#include <task_scheduler.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <vector>
+
+namespace
+{
+    /**
+     * @brief Runs func and gets its wall time in seconds.
+    */
+    template <typename F>
+    double time_seconds(F&& func)
+    {
+        auto start = std::chrono::steady_clock::now();
+        func();
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    /**
+     * @brief Runs func once to warm caches and lazily built state up, then gets the median wall time of a few more
+     *        runs, so that a single noisy run does not decide the choice.
+    */
+    template <typename F>
+    double median_seconds(F&& func)
+    {
+        const size_t runs = 3;
+
+        func();
+
+        std::vector<double> times(runs);
+        for(double& seconds : times)
+        {
+            seconds = time_seconds(func);
+        }
+
+        std::nth_element(times.begin(), times.begin() + runs / 2, times.end());
+        return times[runs / 2];
+    }
+
+    /**
+     * @brief Picks count bodies spread evenly over a vector.
+    */
+    std::vector<body*> spread_sample(const std::vector<body*>& bodies, size_t count, std::vector<size_t>* indices = nullptr)
+    {
+        std::vector<body*> sample(count);
+
+        for(size_t i = 0; i < count; ++i)
+        {
+            size_t index = i * bodies.size() / count;
+            sample[i] = bodies[index];
+
+            if(indices != nullptr)
+            {
+                indices -> push_back(index);
+            }
+        }
+
+        return sample;
+    }
+}
+
+/**
+ * @brief Construct a new autotuner object.
+ *
+ * @param _tolerance Largest relative RMS acceleration error accepted, compared with direct summation.
+ * @param _retune_interval Number of steps between two tunings.
+ * @param _log Stream told about every choice, or nullptr to tune silently.
+*/
+simulation::autotuner::autotuner(double _tolerance, size_t _retune_interval, std::ostream* _log)
+: tolerance{_tolerance}, retune_interval{std::max<size_t>(1, _retune_interval)}, log{_log}
+{
+
+}
+
+/**
+ * @brief Counts a step and determines whether the configuration should be tuned (again) before it.
+ *
+ * @return bool True if tune() should be called.
+*/
+bool simulation::autotuner::due()
+{
+    if(!tuned || ++steps_since_tune >= retune_interval)
+    {
+        steps_since_tune = 0;
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Gets the configuration chosen by the last tuning.
+*/
+const simulation::solver_config& simulation::autotuner::get_config() const
+{
+    return best;
+}
+
+/**
+ * @brief Gets the relative RMS acceleration error of the chosen configuration measured by the last tuning.
+*/
+double simulation::autotuner::get_error() const
+{
+    return best_error;
+}
+
+/**
+ * @brief Gets the estimated seconds per step of the chosen configuration measured by the last tuning.
+*/
+double simulation::autotuner::get_estimate() const
+{
+    return best_estimate;
+}
+
+/**
+ * @brief Gets the relative RMS difference between two sets of accelerations.
+*/
+double simulation::autotuner::relative_error(const std::vector<sf::Vector2<double>>& accels, const std::vector<sf::Vector2<double>>& reference) const
+{
+    double error{};
+    double norm{};
+
+    for(size_t i = 0; i < reference.size(); ++i)
+    {
+        sf::Vector2<double> delta = accels[i] - reference[i];
+        error += delta.x * delta.x + delta.y * delta.y;
+        norm += reference[i].x * reference[i].x + reference[i].y * reference[i].y;
+    }
+
+    return norm > 0 ? std::sqrt(error / norm) : 0;
+}
+
+/**
+ * @brief Times the candidate configurations on the current bodies and keeps the fastest one within the tolerance,
+ *        or the most accurate one if none is. Opening angles stop at 0.7, below 1 / sqrt(2), so that a cell is never
+ *        accepted by a body inside it.
+ *
+ * @param bodies The bodies in the sim.
+ * @param mesh Particle mesh timed as the particle mesh candidate.
+ * @param scheduler The caller's scheduler, reused to time its own thread count.
+ * @return const solver_config& The chosen configuration.
+*/
+const simulation::solver_config& simulation::autotuner::tune(const std::vector<body*>& bodies, particle_mesh& mesh, task_scheduler& scheduler)
+{
+    const double sample_budget = 2e8;
+    const size_t max_sample = 256;
+    const size_t min_sample = 16;
+    const size_t max_probe = 1 << 15;
+
+    const double opening_angles[] = {0.3, 0.5, 0.7};
+    const size_t leaf_sizes[] = {1, 4, 8, 16};
+
+    tuned = true;
+
+    size_t num_bodies = bodies.size();
+    if(num_bodies < 2)
+    {
+        best = solver_config{solver_type::brute_force};
+        best_error = 0;
+        best_estimate = 0;
+        return best;
+    }
+
+    size_t probe_size = std::min(num_bodies, max_probe);
+    std::vector<body*> probe = spread_sample(bodies, probe_size);
+
+    size_t sample_size = std::clamp<size_t>(static_cast<size_t>(sample_budget / num_bodies), min_sample, max_sample);
+    sample_size = std::min(sample_size, probe_size);
+
+    std::vector<size_t> sample_index;
+    std::vector<body*> sample = spread_sample(probe, sample_size, &sample_index);
+
+    double direct_scale = static_cast<double>(num_bodies) / sample_size;
+    double walk_scale = direct_scale * std::log2(num_bodies + 1.0) / std::log2(probe_size + 1.0);
+    double build_scale = num_bodies * std::log2(num_bodies + 1.0) / (probe_size * std::log2(probe_size + 1.0));
+    double mesh_scale = static_cast<double>(num_bodies) / probe_size;
+
+    std::vector<size_t> thread_counts{1, std::max<size_t>(1, worker_count() / 2), worker_count(), scheduler.num_threads()};
+    std::sort(thread_counts.begin(), thread_counts.end());
+    thread_counts.erase(std::unique(thread_counts.begin(), thread_counts.end()), thread_counts.end());
+
+    std::vector<std::unique_ptr<task_scheduler>> owned;
+    std::vector<task_scheduler*> schedulers;
+    for(size_t threads : thread_counts)
+    {
+        if(threads == scheduler.num_threads())
+        {
+            schedulers.push_back(&scheduler);
+        }
+        else
+        {
+            owned.push_back(std::make_unique<task_scheduler>(threads));
+            schedulers.push_back(owned.back().get());
+        }
+    }
+
+    std::vector<sf::Vector2<double>> reference;
+    std::vector<sf::Vector2<double>> accels;
+
+    double best_time = std::numeric_limits<double>::infinity();
+    best_error = std::numeric_limits<double>::infinity();
+    bool best_within = false;
+
+    auto consider = [&](const solver_config& candidate, double seconds, double error)
+    {
+        bool within = error <= tolerance;
+
+        if((within && (!best_within || seconds < best_time)) || (!within && !best_within && error < best_error))
+        {
+            best = candidate;
+            best_time = seconds;
+            best_error = error;
+            best_within = within;
+        }
+    };
+
+    brute_force_accels(probe, sample, reference, &scheduler);
+
+    for(size_t t = 0; t < thread_counts.size(); ++t)
+    {
+        double direct_time = median_seconds([&]() { brute_force_accels(bodies, sample, accels, schedulers[t]); });
+        consider(solver_config{solver_type::brute_force, 0, 1, thread_counts[t]}, direct_time * direct_scale, 0);
+    }
+
+    for(size_t leaf_size : leaf_sizes)
+    {
+        std::unique_ptr<b_h_tree> probe_tree;
+
+        std::vector<double> build_times(thread_counts.size());
+        for(size_t t = 0; t < thread_counts.size(); ++t)
+        {
+            build_times[t] = build_scale * median_seconds([&]() { probe_tree = std::make_unique<b_h_tree>(probe, schedulers[t], settings::RATIO_EPSILON, leaf_size); });
+        }
+
+        for(double opening_angle : opening_angles)
+        {
+            probe_tree -> set_opening_angle(opening_angle);
+            probe_tree -> compute_accels(sample, accels, &scheduler);
+
+            double error = relative_error(accels, reference);
+
+            for(size_t t = 0; t < thread_counts.size(); ++t)
+            {
+                double walk_time = median_seconds([&]() { probe_tree -> compute_accels(sample, accels, schedulers[t]); });
+
+                consider(solver_config{solver_type::barnes_hut, opening_angle, leaf_size, thread_counts[t]}, build_times[t] + walk_time * walk_scale, error);
+            }
+        }
+    }
+
+    std::vector<sf::Vector2<double>> mesh_accels;
+    double mesh_time = median_seconds([&]() { mesh.compute(probe, mesh_accels, scheduler); });
+
+    for(size_t i = 0; i < sample_size; ++i)
+    {
+        accels[i] = mesh_accels[sample_index[i]];
+    }
+
+    consider(solver_config{solver_type::particle_mesh, 0, 1, scheduler.num_threads()}, mesh_time * mesh_scale, relative_error(accels, reference));
+
+    best_estimate = best_time;
+
+    if(log != nullptr)
+    {
+        *log << "autotune: " << solver_name(best.solver) << ", opening angle " << best.opening_angle
+             << ", leaf size " << best.leaf_size << ", threads " << best.num_threads
+             << ", error " << best_error << ", est. " << best_estimate << " s/step" << std::endl;
+    }
+
+    return best;
+}
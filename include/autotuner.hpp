@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <vector>
+#include <SFML/System/Vector2.hpp>
+#include <body.hpp>
+#include <solver.hpp>
+
+namespace simulation
+{
+    class particle_mesh;
+
+    class task_scheduler;
+
+    /**
+     * @brief The autotuner object picks the fastest solver configuration for the current body distribution whose
+     *        error stays within a tolerance. Each candidate (brute force, Barnes Hut over a grid of opening angles,
+     *        leaf sizes and thread counts, and the particle mesh) is probed briefly on a probe of at most 32768 bodies
+     *        spread over the system. Errors come from one probe tree per leaf size, walked at every opening angle
+     *        for a sample of the probe and compared with a direct sum over the probe. Times come from those builds
+     *        and walks and from the mesh run over the probe, scaled to the whole system; every timing is warmed up
+     *        once and taken as the median of a few runs. The caller's scheduler times its own thread count, so only
+     *        the other counts get a scheduler of their own. The choice is refreshed every retune_interval steps as
+     *        the system evolves.
+    */
+    class autotuner
+    {
+        private:
+            double tolerance{};
+            size_t retune_interval{};
+            size_t steps_since_tune{};
+            bool tuned{};
+            solver_config best{};
+            double best_error{};
+            double best_estimate{};
+            std::ostream* log{};
+
+            double relative_error(const std::vector<sf::Vector2<double>>& accels, const std::vector<sf::Vector2<double>>& reference) const;
+
+        public:
+
+            autotuner(double _tolerance = 0.01, size_t _retune_interval = 500, std::ostream* _log = nullptr);
+
+            bool due();
+
+            const solver_config& tune(const std::vector<body*>& bodies, particle_mesh& mesh, task_scheduler& scheduler);
+
+            const solver_config& get_config() const;
+
+            double get_error() const;
+
+            double get_estimate() const;
+    };
+}
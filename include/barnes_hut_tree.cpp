@@ -1,6 +1,9 @@
 #include <barnes_hut_tree.hpp>
-#include <SFML/Graphics.hpp>
+#include <SFML/System/Vector2.hpp>
 #include <iostream>
+#include <algorithm>
+#include <task_scheduler.hpp>
+#include <force_kernels.hpp>
 
 //inner node struct definitions//
 
@@ -18,9 +21,10 @@ b_h_tree::b_h_node::b_h_node()
  * @param _top_left The top left coordinate of the quadrant that this node will represent.
  * @param _width The width of the quadrant that this node will represent.
  * @param _height The height of the quadrant that this node will represent.
+ * @param _depth The depth of this node in the quadtree.
 */
-b_h_tree::b_h_node::b_h_node(sf::Vector2<int> _top_left, int _width, int _height)
-: top_left{_top_left}, width{_width}, height{_height}
+b_h_tree::b_h_node::b_h_node(sf::Vector2<double> _top_left, double _width, double _height, int _depth)
+: top_left{_top_left}, width{_width}, height{_height}, depth{_depth}
 {
 
 }
@@ -32,17 +36,18 @@ b_h_tree::b_h_node::b_h_node(sf::Vector2<int> _top_left, int _width, int _height
 */
 bool b_h_tree::b_h_node::is_internal()
 {
-    return node_body == nullptr && children.size() != 0;
+    return children.size() != 0;
 }
 
 /**
- * @brief Determines whether this node is an external node. An external node represents a single body object. It is a leaf of the quadtree.
+ * @brief Determines whether this node is an external node. An external node represents the body objects stored in it
+ *        (up to the leaf size of the tree, more only if several bodies coincide). It is a leaf of the quadtree.
  * 
  * @return bool True if this node is an external node, false otherwise.
 */
 bool b_h_tree::b_h_node::is_external()
 {
-    return node_body != nullptr && children.size() == 0;
+    return leaf_count != 0 && children.size() == 0;
 }
 
 /**
@@ -52,17 +57,23 @@ bool b_h_tree::b_h_node::is_external()
 */
 bool b_h_tree::b_h_node::is_empty()
 {
-    return node_body == nullptr && children.size() == 0;
+    return leaf_count == 0 && children.size() == 0;
 }
 
 /**
- * @brief Updates the total mass of this node, if this node is an inner node.
+ * @brief Updates the total mass of this node from its bodies or, if this node is an inner node, from its children.
 */
 void b_h_tree::b_h_node::update_total_mass()
 {
     if(is_external())
     {
-        total_mass = node_body -> get_mass();
+        double new_total_mass{};
+        for(size_t i = 0; i < leaf_count; ++i)
+        {
+            new_total_mass += leaf_bodies[i] -> get_mass();
+        }
+
+        total_mass = new_total_mass;
     }
     else if(is_internal())
     {
@@ -77,28 +88,35 @@ void b_h_tree::b_h_node::update_total_mass()
 }
 
 /**
- * @brief Updates the center of mass represented by this node, if this node is an inner node.
+ * @brief Updates the center of mass represented by this node. Requires total_mass to be up to date.
 */
 void b_h_tree::b_h_node::update_center_of_mass()
 {
+    sf::Vector2<double> new_center_of_mass{};
+
     if(is_external())
     {
-        center_of_mass = node_body -> get_position();
+        for(size_t i = 0; i < leaf_count; ++i)
+        {
+            new_center_of_mass += leaf_bodies[i] -> get_position() * leaf_bodies[i] -> get_mass();
+        }
     }
     else if(is_internal())
     {
-        sf::Vector2<double> new_center_of_mass{};
-
         for(std::shared_ptr<b_h_node> child_node: children)
         {
             new_center_of_mass += ((child_node -> center_of_mass) * child_node -> total_mass);
         }
-
-        new_center_of_mass /= total_mass;
-
-        center_of_mass = new_center_of_mass;
     }
 
+    if(total_mass > 0)
+    {
+        center_of_mass = new_center_of_mass / total_mass;
+    }
+    else if(is_external())
+    {
+        center_of_mass = leaf_bodies[0] -> get_position();
+    }
 }
 
 /**
@@ -120,13 +138,13 @@ bool b_h_tree::b_h_node::in_quadrant(body* b)
 */
 void b_h_tree::b_h_node::create_children()
 {
-    int half_width = width / 2;
-    int half_height = height / 2;
+    double half_width = width / 2;
+    double half_height = height / 2;
 
-    std::shared_ptr<b_h_node> q1 = std::make_shared<b_h_node>(sf::Vector2(top_left.x + half_width, top_left.y), half_width, half_height);
-    std::shared_ptr<b_h_node> q2 = std::make_shared<b_h_node>(top_left, half_width, half_height);
-    std::shared_ptr<b_h_node> q3 = std::make_shared<b_h_node>(sf::Vector2(top_left.x, top_left.y + half_height), half_width, half_height);
-    std::shared_ptr<b_h_node> q4 = std::make_shared<b_h_node>(sf::Vector2(top_left.x + half_width, top_left.y + half_height), half_width, half_height);
+    std::shared_ptr<b_h_node> q1 = std::make_shared<b_h_node>(sf::Vector2(top_left.x + half_width, top_left.y), half_width, half_height, depth + 1);
+    std::shared_ptr<b_h_node> q2 = std::make_shared<b_h_node>(top_left, half_width, half_height, depth + 1);
+    std::shared_ptr<b_h_node> q3 = std::make_shared<b_h_node>(sf::Vector2(top_left.x, top_left.y + half_height), half_width, half_height, depth + 1);
+    std::shared_ptr<b_h_node> q4 = std::make_shared<b_h_node>(sf::Vector2(top_left.x + half_width, top_left.y + half_height), half_width, half_height, depth + 1);
 
     children.push_back(q1);
     children.push_back(q2);
@@ -137,145 +155,711 @@ void b_h_tree::b_h_node::create_children()
 
 //tree definitions  
 /**
- * @brief Constructs the quadtree.
+ * @brief Constructs the quadtree. The bodies are recursively partitioned into the four quadrants of each node and
+ *        every node's total mass and center of mass are computed once its children are complete. With a scheduler,
+ *        large subtrees are built as separate tasks.
+ *        Check https://www.cs.princeton.edu/courses/archive/fall03/cs126/assignments/barnes-hut.html
+ *        for the algorithm.
  * 
  * @param bodies Vector containing pointers to bodies in the sim from which the tree will be constructed.
+ * @param scheduler Scheduler running the subtree builds in parallel, or nullptr to build on the calling thread. If its
+ *        threads are pinned, the arrays walked by get_accel() are spread over the workers' memory nodes on huge pages.
+ * @param _opening_angle A cell is approximated by its center of mass once width / distance drops below this ratio.
+ * @param _leaf_size Largest number of bodies kept in a single leaf. Larger leaves make the tree shallower and trade
+ *        cell interactions for direct body interactions.
+ * @param spill_directory Directory of the files backing the node and leaf arrays in out-of-core runs, or nullptr to
+ *        keep them in memory.
 */
-b_h_tree::b_h_tree(const std::vector<body*>& bodies)
+b_h_tree::b_h_tree(const std::vector<body*>& bodies, simulation::task_scheduler* scheduler, double _opening_angle, size_t _leaf_size, std::shared_ptr<const std::string> spill_directory)
+: opening_angle{_opening_angle}, leaf_size{std::max<size_t>(1, _leaf_size)}
 {
-    root = std::make_shared<b_h_node>(sf::Vector2<int>(0, 0), settings::DIMENSIONS.first, settings::DIMENSIONS.second);
+    root = std::make_shared<b_h_node>(sf::Vector2<double>(0, 0), settings::DIMENSIONS.first, settings::DIMENSIONS.second);
 
-    for(body* b : bodies)
+    bool pinned = scheduler != nullptr && scheduler -> is_pinned();
+
+    if(pinned || spill_directory)
+    {
+        sorted_bodies = body_list(simulation::placed_allocator<body*>{pinned ? scheduler : nullptr, pinned && !spill_directory, spill_directory});
+    }
+
+    sorted_bodies.assign(bodies.begin(), bodies.end());
+
+    auto outside = std::partition(sorted_bodies.begin(), sorted_bodies.end(), [this](body* b) { return root -> in_quadrant(b); });
+    sorted_bodies.erase(outside, sorted_bodies.end());
+
+    if(scheduler != nullptr)
+    {
+        simulation::task_group group{*scheduler};
+        group.spawn([this, scheduler]() { build_node(root, 0, sorted_bodies.size(), scheduler); });
+        group.wait();
+    }
+    else
     {
-        insert_node(root, b);
+        build_node(root, 0, sorted_bodies.size(), nullptr);
     }
+
+    if(pinned || spill_directory)
+    {
+        simulation::placed_allocator<double> placed{pinned ? scheduler : nullptr, pinned && !spill_directory, spill_directory};
+
+        leaf_mass = decltype(leaf_mass)(placed);
+        leaf_x = decltype(leaf_x)(placed);
+        leaf_y = decltype(leaf_y)(placed);
+        leaf_radius = decltype(leaf_radius)(placed);
+        flat_nodes = decltype(flat_nodes)(placed);
+    }
+
+    flat_nodes.reserve(2 * sorted_bodies.size() / leaf_size + 1);
+
+    leaf_mass.resize(sorted_bodies.size());
+    leaf_x.resize(sorted_bodies.size());
+    leaf_y.resize(sorted_bodies.size());
+    leaf_radius.resize(sorted_bodies.size());
+
+    for(size_t i = 0; i < sorted_bodies.size(); ++i)
+    {
+        sf::Vector2<double> position = sorted_bodies[i] -> get_position();
+
+        leaf_mass[i] = sorted_bodies[i] -> get_mass();
+        leaf_x[i] = position.x;
+        leaf_y[i] = position.y;
+        leaf_radius[i] = sorted_bodies[i] -> get_radius();
+    }
+
+    flatten(root);
 }
 
 /**
- * @brief Gets the acceleration induced on the body being pointed to by b.
+ * @brief Changes the opening angle of the following walks. The layout of the tree does not depend on it, so a single
+ *        build can be walked at several angles.
  * 
- * @param b The induced acceleration on the body pointed to by b from other bodies will be returned.
- * @return sf::Vector2<double> Acceleration vector induced on b.
+ * @param _opening_angle The new opening angle.
 */
-sf::Vector2<double> b_h_tree::get_accel(body* b) const
+void b_h_tree::set_opening_angle(double _opening_angle)
 {
-    return calc_accel(root, b);
+    opening_angle = _opening_angle;
 }
 
 /**
- * @brief Recursively inserts a node representing a body in the system into the quadtree. This is the crux in
- *        constructing the quadtree utilized in the Barnes Hut algorithm.
+ * @brief Gets the acceleration induced on the body being pointed to by b. The tree is walked as a single loop over
+ *        the depth-first layout: a far enough cell is applied as a point mass and its subtree skipped through the
+ *        next index, otherwise the walk steps into the cell's first child. Nothing is allocated or reference counted
+ *        per visited node. Accepted cells and leaf bodies are gathered into small batches summed by the active
+ *        force kernels, so the interactions themselves run in SIMD.
  *        Check https://www.cs.princeton.edu/courses/archive/fall03/cs126/assignments/barnes-hut.html
  *        for the algorithm.
  * 
- * @param root The node being examined in current recursive call.
- * @param new_body Pointer to the body object that is being inserted into the quadtree.
+ * @param b The induced acceleration on the body pointed to by b from other bodies will be returned.
+ * @return sf::Vector2<double> Acceleration vector induced on b.
 */
-void b_h_tree::insert_node(std::shared_ptr<b_h_node> root, body* new_body)
+sf::Vector2<double> b_h_tree::get_accel(body* b) const
 {
-    if(root -> is_empty())
+    const size_t batch = 64;
+
+    sf::Vector2<double> position = b -> get_position();
+    double radius = b -> get_radius();
+
+    simulation::accumulate_kernel accumulate = simulation::active_kernels().accumulate;
+
+    double batch_x[batch];
+    double batch_y[batch];
+    double batch_mass[batch];
+    double batch_radius[batch];
+    size_t pending = 0;
+
+    double accel_x = 0;
+    double accel_y = 0;
+
+    auto add_source = [&](double x, double y, double mass, double source_radius)
     {
-        root -> node_body = new_body;
-    }
-    else if(root -> is_internal())
+        if(pending == batch)
+        {
+            accumulate(position.x, position.y, radius, batch_x, batch_y, batch_mass, batch_radius, pending, accel_x, accel_y);
+            pending = 0;
+        }
+
+        batch_x[pending] = x;
+        batch_y[pending] = y;
+        batch_mass[pending] = mass;
+        batch_radius[pending] = source_radius;
+        ++pending;
+    };
+
+    size_t index = 0;
+    size_t num_nodes = flat_nodes.size();
+
+    while(index < num_nodes)
     {
+        const flat_node& node = flat_nodes[index];
 
-        for(std::shared_ptr<b_h_node>  quadrant : root -> children)
+        if(node.body_count != 0)
         {
-            if(quadrant -> in_quadrant(new_body))
+            for(size_t i = node.first_body; i < node.first_body + node.body_count; ++i)
             {
-                insert_node(quadrant, new_body);
-                break;
+                if(sorted_bodies[i] != b)
+                {
+                    add_source(leaf_x[i], leaf_y[i], leaf_mass[i], leaf_radius[i]);
+                }
             }
+
+            index = node.next;
+            continue;
+        }
+
+        double delta_x = node.center_x - position.x;
+        double delta_y = node.center_y - position.y;
+        double distance = std::sqrt(delta_x * delta_x + delta_y * delta_y);
+
+        if(node.width < opening_angle * distance)
+        {
+            add_source(node.center_x, node.center_y, node.total_mass, 0);
+            index = node.next;
+        }
+        else
+        {
+            ++index;
         }
-        root -> update_total_mass();
-        root -> update_center_of_mass();
     }
-    else if(root -> is_external())
+
+    accumulate(position.x, position.y, radius, batch_x, batch_y, batch_mass, batch_radius, pending, accel_x, accel_y);
+
+    return sf::Vector2<double>{accel_x, accel_y};
+}
+
+/**
+ * @brief Gets the acceleration induced on every body of a vector. With a scheduler, the bodies are walked in blocks
+ *        that idle threads steal from each other, which keeps the threads balanced when some bodies sit in dense
+ *        clusters and take far longer to walk than others. With pinned threads, each worker instead walks its own
+ *        static_block() of the bodies, the block whose memory it placed.
+ * 
+ * @param bodies The bodies whose accelerations are calculated.
+ * @param accels Resized to bodies.size(), accels[i] receives the acceleration of bodies[i].
+ * @param scheduler Scheduler running the walks in parallel, or nullptr to walk on the calling thread.
+*/
+void b_h_tree::compute_accels(const std::vector<body*>& bodies, std::vector<sf::Vector2<double>>& accels, simulation::task_scheduler* scheduler) const
+{
+    accels.resize(bodies.size());
+
+    compute_accels(bodies, accels, 0, bodies.size(), scheduler);
+}
+
+/**
+ * @brief Gets the acceleration induced on the bodies [first, last) of a vector, scheduled as by the overload above.
+ *        Out-of-core runs walk the bodies one chunk at a time through this overload.
+ * 
+ * @param bodies The bodies whose accelerations are calculated.
+ * @param accels Sized to at least last - first, accels[i - first] receives the acceleration of bodies[i], so a chunk
+ *        only needs a buffer of its own size.
+ * @param first Index of the first body of the range.
+ * @param last One past the index of the last body of the range.
+ * @param scheduler Scheduler running the walks in parallel, or nullptr to walk on the calling thread.
+*/
+void b_h_tree::compute_accels(const std::vector<body*>& bodies, std::vector<sf::Vector2<double>>& accels, size_t first, size_t last, simulation::task_scheduler* scheduler) const
+{
+    const size_t walk_grain = 256;
+
+    auto walk_block = [this, &bodies, &accels, first](size_t block_begin, size_t block_end)
     {
-        body* body_a = root -> node_body;
+        for(size_t i = block_begin; i < block_end; ++i)
+        {
+            accels[i - first] = get_accel(bodies[i]);
+        }
+    };
 
-        root -> node_body = nullptr;
+    if(scheduler != nullptr && scheduler -> is_pinned())
+    {
+        scheduler -> parallel_for_static(first, last, walk_block);
+    }
+    else if(scheduler != nullptr)
+    {
+        scheduler -> parallel_for(first, last, walk_grain, walk_block);
+    }
+    else
+    {
+        walk_block(first, last);
+    }
+}
+
+/**
+ * @brief Gets the gravitational potential at the body being pointed to by b, walking the tree with the same opening
+ *        criterion as get_accel(), so the cost of an energy measurement matches that of a force evaluation.
+ * 
+ * @param b The body at which the potential of the other bodies is returned.
+ * @return double The potential per unit mass at b.
+*/
+double b_h_tree::get_potential(body* b) const
+{
+    sf::Vector2<double> position = b -> get_position();
+    double radius = b -> get_radius();
+
+    double potential = 0;
 
-        body* body_b = new_body;
+    size_t index = 0;
+    size_t num_nodes = flat_nodes.size();
 
-        root -> create_children();
+    while(index < num_nodes)
+    {
+        const flat_node& node = flat_nodes[index];
 
-        for(std::shared_ptr<b_h_node>  quadrant : root -> children)
+        if(node.body_count != 0)
         {
-            if(quadrant -> in_quadrant(body_a))
+            for(size_t i = node.first_body; i < node.first_body + node.body_count; ++i)
             {
-                insert_node(quadrant, body_a);
-                break;
+                if(sorted_bodies[i] != b)
+                {
+                    potential += potential_kernel(leaf_x[i] - position.x, leaf_y[i] - position.y, radius + leaf_radius[i], leaf_mass[i]);
+                }
             }
+
+            index = node.next;
+            continue;
         }
 
-        for(std::shared_ptr<b_h_node>  quadrant : root -> children)
+        double delta_x = node.center_x - position.x;
+        double delta_y = node.center_y - position.y;
+        double distance = std::sqrt(delta_x * delta_x + delta_y * delta_y);
+
+        if(node.width < opening_angle * distance)
         {
-            if(quadrant -> in_quadrant(body_b))
-            {
-                insert_node(quadrant, body_b);
-                break;
-            }
+            potential += potential_kernel(delta_x, delta_y, radius, node.total_mass);
+            index = node.next;
+        }
+        else
+        {
+            ++index;
         }
+    }
+
+    return potential;
+}
 
-        root -> update_total_mass();
-        root -> update_center_of_mass();
+/**
+ * @brief Asks for the leaf data of the sorted bodies [first, last) to be read ahead of a walk that needs it.
+ * 
+ * @param first Index of the first sorted body.
+ * @param last One past the index of the last sorted body.
+*/
+void b_h_tree::prefetch_leaves(size_t first, size_t last) const
+{
+    last = std::min(last, sorted_bodies.size());
+
+    if(first >= last)
+    {
+        return;
     }
 
+    simulation::prefetch_range(leaf_mass.data() + first, leaf_mass.data() + last);
+    simulation::prefetch_range(leaf_x.data() + first, leaf_x.data() + last);
+    simulation::prefetch_range(leaf_y.data() + first, leaf_y.data() + last);
+    simulation::prefetch_range(leaf_radius.data() + first, leaf_radius.data() + last);
 }
 
 /**
- * @brief Recursively calculates the acceleration induced by the other bodies in the quadtree
- *        on the inputted body.
- *        Check https://www.cs.princeton.edu/courses/archive/fall03/cs126/assignments/barnes-hut.html
- *        for the algorithm.
+ * @brief Marks the leaf data of the sorted bodies [first, last) as the first to reclaim under memory pressure.
  * 
- * @param root The current node being examined in the recursive call.
- * @param b The acceleration induced on the body pointed to by b will be calculated.
- * @return sf::Vector2<double> The induced acceleration produced on the inputted body by the body represented by the current node being examined.
-*          If the a bunch of bodies are far enough, the node will represent a collection of these bodies and the center of mass
-*          formed by these bodies will be used to calculated the induced acceleration and this will be returned.
+ * @param first Index of the first sorted body.
+ * @param last One past the index of the last sorted body.
 */
-sf::Vector2<double> b_h_tree::calc_accel(std::shared_ptr<b_h_node> root, body* b) const
+void b_h_tree::retire_leaves(size_t first, size_t last) const
 {
-    if(root -> is_external() && root -> node_body != b)
+    last = std::min(last, sorted_bodies.size());
+
+    if(first >= last)
     {
-        return b -> calc_accel(root -> node_body);
+        return;
     }
-    else if(root -> is_internal())
+
+    simulation::retire_range(leaf_mass.data() + first, leaf_mass.data() + last);
+    simulation::retire_range(leaf_x.data() + first, leaf_x.data() + last);
+    simulation::retire_range(leaf_y.data() + first, leaf_y.data() + last);
+    simulation::retire_range(leaf_radius.data() + first, leaf_radius.data() + last);
+}
+
+/**
+ * @brief Gets the bodies of the tree in the order of its leaves. Bodies outside the root quadrant are left out.
+*/
+const b_h_tree::body_list& b_h_tree::get_sorted_bodies() const
+{
+    return sorted_bodies;
+}
+
+/**
+ * @brief Refits the tree to the current positions of its bodies without changing its topology: the leaf arrays are
+ *        read again and the mass moments of every node are recomputed bottom-up. Children follow their parent in the
+ *        depth-first layout, so a single reverse pass sees every child before its parent. Node widths are kept.
+ * 
+ * @param scheduler Scheduler reading the bodies in parallel, or nullptr.
+*/
+void b_h_tree::refit(simulation::task_scheduler* scheduler)
+{
+    const size_t refit_grain = 4096;
+
+    auto read_block = [this](size_t block_begin, size_t block_end)
     {
-        double body_pos_x = (b -> get_position()).x;
-        double body_pos_y = (b -> get_position()).y;
+        for(size_t i = block_begin; i < block_end; ++i)
+        {
+            sf::Vector2<double> position = sorted_bodies[i] -> get_position();
+
+            leaf_mass[i] = sorted_bodies[i] -> get_mass();
+            leaf_x[i] = position.x;
+            leaf_y[i] = position.y;
+        }
+    };
 
-        double center_of_mass_x = (root -> center_of_mass).x;
-        double center_of_mass_y = (root -> center_of_mass).y;
+    if(scheduler != nullptr)
+    {
+        scheduler -> parallel_for(0, sorted_bodies.size(), refit_grain, read_block);
+    }
+    else
+    {
+        read_block(0, sorted_bodies.size());
+    }
 
-        double distance = sqrt(pow(body_pos_x - center_of_mass_x, 2) + pow(body_pos_y - center_of_mass_y, 2));
+    for(size_t index = flat_nodes.size(); index-- > 0;)
+    {
+        flat_node& node = flat_nodes[index];
 
-        double ratio = root -> width / distance;
+        double mass = 0;
+        double moment_x = 0;
+        double moment_y = 0;
 
-        if(ratio < settings::RATIO_EPSILON)
+        if(node.body_count != 0)
         {
-            body center_of_mass_rep{root -> total_mass, 0, true, root -> center_of_mass};
+            for(size_t i = node.first_body; i < node.first_body + node.body_count; ++i)
+            {
+                mass += leaf_mass[i];
+                moment_x += leaf_mass[i] * leaf_x[i];
+                moment_y += leaf_mass[i] * leaf_y[i];
+            }
 
-            return b -> calc_accel(&center_of_mass_rep);
+            if(mass <= 0)
+            {
+                moment_x = leaf_x[node.first_body];
+                moment_y = leaf_y[node.first_body];
+            }
         }
         else
         {
-            sf::Vector2<double> net_accel{0, 0};
+            for(size_t child = index + 1; child < node.next; child = flat_nodes[child].next)
+            {
+                mass += flat_nodes[child].total_mass;
+                moment_x += flat_nodes[child].total_mass * flat_nodes[child].center_x;
+                moment_y += flat_nodes[child].total_mass * flat_nodes[child].center_y;
+            }
+        }
+
+        node.total_mass = mass;
+        if(mass > 0)
+        {
+            node.center_x = moment_x / mass;
+            node.center_y = moment_y / mass;
+        }
+        else if(node.body_count != 0)
+        {
+            node.center_x = moment_x;
+            node.center_y = moment_y;
+        }
+    }
+
+    gather_far_cells();
+}
+
+/**
+ * @brief Builds an interaction list for every leaf, shared by the bodies of that leaf: the cells far enough to be
+ *        applied as point masses to the whole leaf, and the leaves whose bodies are summed directly. A cell is only
+ *        accepted if it passes the opening criterion against the closest point of the leaf's bounding box with the
+ *        distance reduced by margin. As long as no body moves further than margin / 2, each cell's center of mass
+ *        and each body of the leaf stay close enough that the plain criterion still holds, so the lists can be
+ *        reused with refit() instead of walking the tree again.
+ * 
+ * @param margin Distance by which bodies may approach accepted cells before the lists must be rebuilt.
+ * @param scheduler Scheduler building the lists in parallel, or nullptr.
+*/
+void b_h_tree::build_interaction_lists(double margin, simulation::task_scheduler* scheduler)
+{
+    const size_t list_grain = 64;
+
+    groups.clear();
+    for(size_t index = 0; index < flat_nodes.size(); ++index)
+    {
+        if(flat_nodes[index].body_count != 0)
+        {
+            groups.push_back(static_cast<std::uint32_t>(index));
+        }
+    }
+
+    std::vector<std::vector<std::uint32_t>> far_lists(groups.size());
+    std::vector<std::vector<std::uint32_t>> near_lists(groups.size());
+
+    auto list_block = [this, margin, &far_lists, &near_lists](size_t block_begin, size_t block_end)
+    {
+        for(size_t g = block_begin; g < block_end; ++g)
+        {
+            const flat_node& group = flat_nodes[groups[g]];
 
-            for(std::shared_ptr<b_h_node>  node : root -> children)
+            double low_x = leaf_x[group.first_body];
+            double high_x = low_x;
+            double low_y = leaf_y[group.first_body];
+            double high_y = low_y;
+
+            for(size_t i = group.first_body + 1; i < group.first_body + group.body_count; ++i)
             {
-                net_accel += calc_accel(node, b);
+                low_x = std::min(low_x, leaf_x[i]);
+                high_x = std::max(high_x, leaf_x[i]);
+                low_y = std::min(low_y, leaf_y[i]);
+                high_y = std::max(high_y, leaf_y[i]);
             }
 
-            return net_accel;
+            size_t index = 0;
+            size_t num_nodes = flat_nodes.size();
+
+            while(index < num_nodes)
+            {
+                const flat_node& node = flat_nodes[index];
+
+                double delta_x = std::max({low_x - node.center_x, 0.0, node.center_x - high_x});
+                double delta_y = std::max({low_y - node.center_y, 0.0, node.center_y - high_y});
+                double distance = std::sqrt(delta_x * delta_x + delta_y * delta_y);
+
+                if(node.body_count != 0)
+                {
+                    near_lists[g].push_back(static_cast<std::uint32_t>(index));
+                    index = node.next;
+                }
+                else if(node.width < opening_angle * (distance - margin))
+                {
+                    far_lists[g].push_back(static_cast<std::uint32_t>(index));
+                    index = node.next;
+                }
+                else
+                {
+                    ++index;
+                }
+            }
         }
+    };
 
+    if(scheduler != nullptr)
+    {
+        scheduler -> parallel_for(0, groups.size(), list_grain, list_block);
     }
     else
     {
-        return sf::Vector2<double>{0, 0};
+        list_block(0, groups.size());
     }
-}   
+
+    far_offsets.assign(1, 0);
+    near_offsets.assign(1, 0);
+    far_cells.clear();
+    near_leaves.clear();
+
+    for(size_t g = 0; g < groups.size(); ++g)
+    {
+        far_cells.insert(far_cells.end(), far_lists[g].begin(), far_lists[g].end());
+        near_leaves.insert(near_leaves.end(), near_lists[g].begin(), near_lists[g].end());
+
+        far_offsets.push_back(static_cast<std::uint32_t>(far_cells.size()));
+        near_offsets.push_back(static_cast<std::uint32_t>(near_leaves.size()));
+    }
+
+    far_x.resize(far_cells.size());
+    far_y.resize(far_cells.size());
+    far_mass.resize(far_cells.size());
+
+    gather_far_cells();
+}
+
+/**
+ * @brief Copies the center of mass and mass of every far cell of the interaction lists into arrays laid out like the
+ *        lists, so each group's far cells are read as contiguous arrays by the force kernels.
+*/
+void b_h_tree::gather_far_cells()
+{
+    for(size_t c = 0; c < far_cells.size(); ++c)
+    {
+        const flat_node& cell = flat_nodes[far_cells[c]];
+
+        far_x[c] = cell.center_x;
+        far_y[c] = cell.center_y;
+        far_mass[c] = cell.total_mass;
+    }
+}
+
+/**
+ * @brief Gets the acceleration of every body of the tree from the interaction lists, without walking the tree.
+ *        Requires build_interaction_lists(), and refit() after the bodies have moved.
+ * 
+ * @param sorted_accels Resized to get_sorted_bodies().size(), sorted_accels[i] receives the acceleration of the i-th
+ *        sorted body.
+ * @param scheduler Scheduler evaluating the lists in parallel, or nullptr.
+*/
+void b_h_tree::compute_accels_from_lists(std::vector<sf::Vector2<double>>& sorted_accels, simulation::task_scheduler* scheduler) const
+{
+    const size_t list_grain = 64;
+
+    sorted_accels.resize(sorted_bodies.size());
+
+    auto group_block = [this, &sorted_accels](size_t block_begin, size_t block_end)
+    {
+        simulation::accumulate_kernel accumulate = simulation::active_kernels().accumulate;
+
+        for(size_t g = block_begin; g < block_end; ++g)
+        {
+            const flat_node& group = flat_nodes[groups[g]];
+
+            for(size_t i = group.first_body; i < group.first_body + group.body_count; ++i)
+            {
+                double x = leaf_x[i];
+                double y = leaf_y[i];
+                double radius = leaf_radius[i];
+
+                double accel_x = 0;
+                double accel_y = 0;
+
+                accumulate(x, y, radius, far_x.data() + far_offsets[g], far_y.data() + far_offsets[g], far_mass.data() + far_offsets[g], nullptr, far_offsets[g + 1] - far_offsets[g], accel_x, accel_y);
+
+                for(size_t l = near_offsets[g]; l < near_offsets[g + 1]; ++l)
+                {
+                    const flat_node& leaf = flat_nodes[near_leaves[l]];
+
+                    size_t first = leaf.first_body;
+                    size_t last = leaf.first_body + leaf.body_count;
+
+                    if(i >= first && i < last)
+                    {
+                        accumulate(x, y, radius, leaf_x.data() + first, leaf_y.data() + first, leaf_mass.data() + first, leaf_radius.data() + first, i - first, accel_x, accel_y);
+                        first = i + 1;
+                    }
+
+                    accumulate(x, y, radius, leaf_x.data() + first, leaf_y.data() + first, leaf_mass.data() + first, leaf_radius.data() + first, last - first, accel_x, accel_y);
+                }
+
+                sorted_accels[i] = sf::Vector2<double>{accel_x, accel_y};
+            }
+        }
+    };
+
+    if(scheduler != nullptr)
+    {
+        scheduler -> parallel_for(0, groups.size(), list_grain, group_block);
+    }
+    else
+    {
+        group_block(0, groups.size());
+    }
+}
+
+/**
+ * @brief Recursively builds the subtree rooted at a node from the bodies sorted_bodies[first, last), which all lie in
+ *        the node's quadrant. The range is partitioned in place into the four quadrants, so every subtree owns a
+ *        contiguous range of sorted_bodies. Subtrees holding many bodies are spawned as tasks.
+ * 
+ * @param node The node being built.
+ * @param first Index of the first body of the node.
+ * @param last One past the index of the last body of the node.
+ * @param scheduler Scheduler used to spawn subtree builds, or nullptr.
+*/
+void b_h_tree::build_node(std::shared_ptr<b_h_node> node, size_t first, size_t last, simulation::task_scheduler* scheduler)
+{
+    const size_t build_grain = 2048;
+
+    const int max_depth = 48;
+
+    size_t count = last - first;
+
+    if(count == 0)
+    {
+        return;
+    }
+
+    if(count <= leaf_size || node -> depth >= max_depth)
+    {
+        node -> leaf_bodies = sorted_bodies.data() + first;
+        node -> leaf_count = count;
+
+        node -> update_total_mass();
+        node -> update_center_of_mass();
+        return;
+    }
+
+    node -> create_children();
+
+    double mid_x = node -> top_left.x + node -> width / 2;
+    double mid_y = node -> top_left.y + node -> height / 2;
+
+    auto begin = sorted_bodies.begin() + first;
+    auto end = sorted_bodies.begin() + last;
+
+    auto bottom = std::partition(begin, end, [mid_y](body* b) { return b -> get_position().y < mid_y; });
+    auto top_left = std::partition(begin, bottom, [mid_x](body* b) { return b -> get_position().x >= mid_x; });
+    auto bottom_right = std::partition(bottom, end, [mid_x](body* b) { return b -> get_position().x < mid_x; });
+
+    size_t bounds[5] = {first,
+                        static_cast<size_t>(top_left - sorted_bodies.begin()),
+                        static_cast<size_t>(bottom - sorted_bodies.begin()),
+                        static_cast<size_t>(bottom_right - sorted_bodies.begin()),
+                        last};
+
+    if(scheduler != nullptr && count > build_grain)
+    {
+        simulation::task_group group{*scheduler};
+
+        for(size_t q = 0; q < 4; ++q)
+        {
+            std::shared_ptr<b_h_node> child = node -> children[q];
+            size_t child_first = bounds[q];
+            size_t child_last = bounds[q + 1];
+
+            group.spawn([this, child, child_first, child_last, scheduler]() { build_node(child, child_first, child_last, scheduler); });
+        }
+
+        group.wait();
+    }
+    else
+    {
+        for(size_t q = 0; q < 4; ++q)
+        {
+            build_node(node -> children[q], bounds[q], bounds[q + 1], scheduler);
+        }
+    }
+
+    node -> update_total_mass();
+    node -> update_center_of_mass();
+}
+
+/**
+ * @brief Appends a subtree to the depth-first layout, skipping empty nodes, and copies the bodies of its leaves into
+ *        the leaf arrays in the same order.
+ * 
+ * @param node Root of the subtree to append.
+*/
+void b_h_tree::flatten(const std::shared_ptr<b_h_node>& node)
+{
+    if(node -> is_empty())
+    {
+        return;
+    }
+
+    size_t index = flat_nodes.size();
+
+    flat_node flat{};
+    flat.total_mass = node -> total_mass;
+    flat.center_x = node -> center_of_mass.x;
+    flat.center_y = node -> center_of_mass.y;
+    flat.width = node -> width;
+
+    if(node -> is_external())
+    {
+        flat.first_body = static_cast<std::uint32_t>(node -> leaf_bodies - sorted_bodies.data());
+        flat.body_count = static_cast<std::uint32_t>(node -> leaf_count);
+    }
+
+    flat_nodes.push_back(flat);
+
+    for(const std::shared_ptr<b_h_node>& child : node -> children)
+    {
+        flatten(child);
+    }
+
+    flat_nodes[index].next = static_cast<std::uint32_t>(flat_nodes.size());
+}
@@ -4,12 +4,20 @@
 #include <utility>
 #include <cmath>
 #include <settings.hpp>
-#include <SFML/Graphics.hpp>
+#include <SFML/System/Vector2.hpp>
 #include <body.hpp>
 #include <memory>
+#include <cstdint>
+#include <string>
+#include <placement.hpp>
 
 class body;
 
+namespace simulation
+{
+    class task_scheduler;
+}
+
 /**
  * @brief The B_H_Tree object represents the quadtree used in the Barnes Hut algorithm. It handles
  *        construction of such a tree and calculating net acceleration on a body from such a tree.
@@ -19,71 +27,148 @@ class b_h_tree
     public:
 
         /**
-         * @brief The b_h_node object represents a single node that will be used by the quadtree that the Barnes Hut 
+         * @brief The b_h_node object represents a single node that will be used by the quadtree that the Barnes Hut
          *        algorithm relies upon.
         */
         struct b_h_node
         {
-            body* node_body{};
+            body* const* leaf_bodies{};
+
+            size_t leaf_count{};
 
             std::vector<std::shared_ptr<b_h_node>> children{};
 
-            sf::Vector2<int> top_left{};
+            sf::Vector2<double> top_left{};
 
-            int width{};
+            double width{};
 
-            int height{};
+            double height{};
 
             int depth{};
 
             double total_mass{};
 
             sf::Vector2<double> center_of_mass{};
-            
+
             b_h_node();
-    
 
-            b_h_node(sf::Vector2<int> _top_left, int _width, int _height);
-            
+
+            b_h_node(sf::Vector2<double> _top_left, double _width, double _height, int _depth = 0);
+
 
             bool is_internal();
-            
+
 
             bool is_external();
-            
+
 
             bool is_empty();
-            
+
 
             void update_total_mass();
-            
+
 
             void update_center_of_mass();
-            
 
-            void add_body(body* new_body);
-            
 
             bool in_quadrant(body* b);
-            
+
 
             void create_children();
-            
+
         };
-        
+
+        /**
+         * @brief A node of the depth-first layout walked by get_accel(). The children of an internal node directly
+         *        follow it, and next is the index of the node that follows its whole subtree, so skipping a subtree is
+         *        a single jump. Leaves hold the range [first_body, first_body + body_count) of the leaf arrays.
+        */
+        struct flat_node
+        {
+            double total_mass{};
+
+            double center_x{};
+
+            double center_y{};
+
+            double width{};
+
+            std::uint32_t next{};
+
+            std::uint32_t first_body{};
+
+            std::uint32_t body_count{};
+        };
+
+        using body_list = std::vector<body*, simulation::placed_allocator<body*>>;
+
         std::shared_ptr<b_h_node> root;
 
+    private:
+
+        body_list sorted_bodies;
+
+        double opening_angle{};
+
+        size_t leaf_size{};
+
+        std::vector<flat_node, simulation::placed_allocator<flat_node>> flat_nodes;
+
+        std::vector<double, simulation::placed_allocator<double>> leaf_mass;
+
+        std::vector<double, simulation::placed_allocator<double>> leaf_x;
+
+        std::vector<double, simulation::placed_allocator<double>> leaf_y;
+
+        std::vector<double, simulation::placed_allocator<double>> leaf_radius;
+
+        std::vector<std::uint32_t> groups;
+
+        std::vector<std::uint32_t> far_offsets;
+
+        std::vector<std::uint32_t> far_cells;
+
+        std::vector<double> far_x;
+
+        std::vector<double> far_y;
+
+        std::vector<double> far_mass;
+
+        std::vector<std::uint32_t> near_offsets;
+
+        std::vector<std::uint32_t> near_leaves;
+
+        void build_node(std::shared_ptr<b_h_node> node, size_t first, size_t last, simulation::task_scheduler* scheduler);
+
+        void flatten(const std::shared_ptr<b_h_node>& node);
+
+        void gather_far_cells();
+
     public:
 
-        b_h_tree(const std::vector<body*>& bodies);
-        
+        b_h_tree(const std::vector<body*>& bodies, simulation::task_scheduler* scheduler = nullptr, double _opening_angle = settings::RATIO_EPSILON, size_t _leaf_size = 1, std::shared_ptr<const std::string> spill_directory = nullptr);
+
+        void set_opening_angle(double _opening_angle);
+
         sf::Vector2<double> get_accel(body* b) const;
 
-        void insert_node(std::shared_ptr<b_h_node> root, body* new_body);
-        
+        void compute_accels(const std::vector<body*>& bodies, std::vector<sf::Vector2<double>>& accels, simulation::task_scheduler* scheduler = nullptr) const;
 
-        sf::Vector2<double> calc_accel(std::shared_ptr<b_h_node> root, body* b) const;
-         
-    };
+        void compute_accels(const std::vector<body*>& bodies, std::vector<sf::Vector2<double>>& accels, size_t first, size_t last, simulation::task_scheduler* scheduler = nullptr) const;
+
+        double get_potential(body* b) const;
 
+        void prefetch_leaves(size_t first, size_t last) const;
+
+        void retire_leaves(size_t first, size_t last) const;
+
+        const body_list& get_sorted_bodies() const;
+
+        void refit(simulation::task_scheduler* scheduler = nullptr);
+
+        void build_interaction_lists(double margin, simulation::task_scheduler* scheduler = nullptr);
+
+        void compute_accels_from_lists(std::vector<sf::Vector2<double>>& sorted_accels, simulation::task_scheduler* scheduler = nullptr) const;
+
+    };
 
@@ -1,5 +1,5 @@
 #include <body.hpp>
-#include <SFML/Graphics.hpp>
+#include <SFML/System/Vector2.hpp>
 
 /**
  * @brief Construct a new body object.
@@ -46,86 +46,96 @@ sf::Vector2<double> body::get_position()
 
 
 /**
- * @brief Function to call to initiate updating of position given 
- *        a vector of other bodies exerting a force on this body and
- *        a small time segment. Uses naive method.
- * 
- * @param bodies Vector containing other bodies exerting a force on this body.
- * @param dt Time segment (time since last frame update) in seconds.
+ * @brief Gets the velocity of the body.
+ * @return sf::Vector2<double> The 2D velocity of the body.
  */
-void body::update_position(const std::vector<body*>& bodies, double dt)
+sf::Vector2<double> body::get_velocity()
 {
-    if(!inplace)
-    {
-        increment_position(dt);
-        update_velocity(bodies, dt);
-    }
+    return velocity;
+}
 
-    if(position.x < 0 || position.x > settings::DIMENSIONS.first)
-    {
-        if(position.x < 0)
-        {
-            position = sf::Vector2<double>{radius * 1.0, position.y};
-        }
-        if(position.x > settings::DIMENSIONS.first)
-        {
-            position = sf::Vector2<double>{settings::DIMENSIONS.first - radius * 1.0, position.y};
-        }
 
-    }
-    if(position.y < 0 || position.y > settings::DIMENSIONS.second)
-    {
-        if(position.y < 0)
-        {
-            position = sf::Vector2<double>{position.x, radius * 1.0};
-        }
-        if(position.y > settings::DIMENSIONS.second)
-        {
-            position = sf::Vector2<double>{position.x, settings::DIMENSIONS.second - radius * 1.0};
-        }
-    }
+/**
+ * @brief Gets whether the body is held in place.
+ * @return bool True if the body cannot move.
+ */
+bool body::is_inplace()
+{
+    return inplace;
+}
+
 
+/**
+ * @brief Gets a reference to the mass of the body. Stays valid as long as the body is not moved.
+ * @return const double& The mass of the body.
+ */
+const double& body::mass_ref() const
+{
+    return mass;
 }
 
+
 /**
- * @brief Function to call to initiate updating of position using the 
- *        Barnes Hut approximation method.
+ * @brief Gets a reference to the position of the body, for views reading it in place. Stays valid as long as the
+ *        body is not moved.
+ * @return const sf::Vector2<double>& The 2D coordinates of the body.
+ */
+const sf::Vector2<double>& body::position_ref() const
+{
+    return position;
+}
+
+
+/**
+ * @brief Gets a reference to the velocity of the body. Stays valid as long as the body is not moved.
+ * @return const sf::Vector2<double>& The 2D velocity of the body.
+ */
+const sf::Vector2<double>& body::velocity_ref() const
+{
+    return velocity;
+}
+
+
+/**
+ * @brief Gets a reference to the acceleration applied by the last kick. Stays valid as long as the body is not moved.
+ * @return const sf::Vector2<double>& The 2D acceleration of the body.
+ */
+const sf::Vector2<double>& body::acceleration_ref() const
+{
+    return acceleration;
+}
+
+
+/**
+ * @brief First half of a batched update: moves the body along its current velocity. Used by solvers that
+ *        compute the accelerations of all bodies at once, after every body has drifted.
  * 
- * @param body_tree Barnes Hut quadtree containing the bodies in the sim.
  * @param dt Time segment (time since last frame update) in seconds.
  */
-void body::update_position_barnes_hut(const b_h_tree& body_tree, double dt)
+void body::drift(double dt)
 {
     if(!inplace)
     {
         increment_position(dt);
-        update_velocity_barnes_hut(body_tree, dt);
     }
+}
 
-    if(position.x < 0 || position.x > settings::DIMENSIONS.first)
-    {
-        if(position.x < 0)
-        {
-            position = sf::Vector2<double>{radius * 1.0, position.y};
-        }
-        if(position.x > settings::DIMENSIONS.first)
-        {
-            position = sf::Vector2<double>{settings::DIMENSIONS.first - radius * 1.0, position.y};
-        }
-
-    }
-    if(position.y < 0 || position.y > settings::DIMENSIONS.second)
+/**
+ * @brief Second half of a batched update: applies an acceleration computed by a solver to the velocity of the body.
+ * 
+ * @param accel The acceleration induced on this body by the other bodies.
+ * @param dt Time segment (time since last frame update) in seconds.
+ */
+void body::kick(sf::Vector2<double> accel, double dt)
+{
+    if(!inplace)
     {
-        if(position.y < 0)
-        {
-            position = sf::Vector2<double>{position.x, radius * 1.0};
-        }
-        if(position.y > settings::DIMENSIONS.second)
-        {
-            position = sf::Vector2<double>{position.x, settings::DIMENSIONS.second - radius * 1.0};
-        }
+        reflect_at_bounds();
+        acceleration = accel;
+        increment_velocity(dt);
     }
 
+    keep_in_bounds();
 }
 
 /**
@@ -139,86 +149,134 @@ sf::Vector2<double> body::calc_accel(const body* bodyptr)
     double x_dist = bodyptr -> position.x - this -> position.x;
     double y_dist = bodyptr -> position.y - this -> position.y;
 
-    double theta = atan2(y_dist, x_dist);
-
-    double dist_mag = sqrt(pow(x_dist, 2) + pow(y_dist, 2));
-
-    double accel_mult = 1;
-    if(dist_mag <= this -> radius + bodyptr -> radius)
-    {
-
-        dist_mag = this -> radius + bodyptr -> radius;
-        accel_mult = -1;
-    }
+    return gravity_kernel(x_dist, y_dist, this -> radius + bodyptr -> radius, bodyptr -> mass);
+}
 
-    double accel_mag = (settings::G * bodyptr -> mass) / (pow(dist_mag, 2));
 
-    accel_mag *= accel_mult;
+/**
+ * @brief Determines whether this body overlaps another body.
+ * 
+ * @param bodyptr Pointer to the other body.
+ * @return bool True if the two bodies overlap.
+ */
+bool body::overlaps(const body* bodyptr)
+{
+    double x_dist = bodyptr -> position.x - this -> position.x;
+    double y_dist = bodyptr -> position.y - this -> position.y;
 
-    sf::Vector2<double> new_acceleration{accel_mag * cos(theta), accel_mag * sin(theta)};
+    double reach = this -> radius + bodyptr -> radius;
 
-    return new_acceleration;
+    return x_dist * x_dist + y_dist * y_dist < reach * reach;
 }
 
-
 /**
- * @brief Increments the position of the body given some 
- *        time segment and velocity.
+ * @brief Resolves a perfectly elastic collision between this body and another overlapping body. The bodies are
+ *        pushed apart so they no longer overlap and exchange momentum along the line between their centers.
+ *        Bodies held in place behave as if they had infinite mass.
  * 
- * @param dt Time segment from last frame in seconds.
+ * @param bodyptr Pointer to the other body taking part in the collision.
  */
-void body::increment_position(double dt)
+void body::bounce(body* bodyptr)
 {
-    sf::Vector2<double> delta_x = velocity * dt;
-    position = position + delta_x;
+    double inv_mass_a = (this -> inplace || this -> mass <= 0) ? 0 : 1 / this -> mass;
+    double inv_mass_b = (bodyptr -> inplace || bodyptr -> mass <= 0) ? 0 : 1 / bodyptr -> mass;
+
+    double inv_mass_sum = inv_mass_a + inv_mass_b;
+    if(inv_mass_sum == 0)
+    {
+        return;
+    }
+
+    sf::Vector2<double> delta = bodyptr -> position - this -> position;
+    double dist_mag = sqrt(delta.x * delta.x + delta.y * delta.y);
+
+    sf::Vector2<double> normal = dist_mag > 0 ? delta / dist_mag : sf::Vector2<double>{1, 0};
+
+    double overlap = this -> radius + bodyptr -> radius - dist_mag;
+    if(overlap > 0)
+    {
+        this -> position -= normal * (overlap * inv_mass_a / inv_mass_sum);
+        bodyptr -> position += normal * (overlap * inv_mass_b / inv_mass_sum);
+    }
+
+    sf::Vector2<double> rel_velocity = bodyptr -> velocity - this -> velocity;
+    double approach_speed = rel_velocity.x * normal.x + rel_velocity.y * normal.y;
+
+    if(approach_speed < 0)
+    {
+        double impulse = -2 * approach_speed / inv_mass_sum;
+
+        this -> velocity -= normal * (impulse * inv_mass_a);
+        bodyptr -> velocity += normal * (impulse * inv_mass_b);
+    }
 }
 
 /**
- * @brief Increments the velocity of the body given some 
- *        time segment and acceleration.
+ * @brief Merges another body into this body in a perfectly inelastic collision. Mass and momentum are conserved,
+ *        the merged body sits at the combined center of mass and its area is the sum of both areas. If either body
+ *        is held in place, the merged body is held in place at that position.
  * 
- * @param dt Time segment (time since last frame update) in seconds.
+ * @param bodyptr Pointer to the body being absorbed. The caller removes it from the simulation afterwards.
  */
-void body::increment_velocity(double dt)
+void body::absorb(const body* bodyptr)
 {
-    sf::Vector2<double> delta_v = acceleration * dt;
-    velocity = velocity + delta_v;
+    double total_mass = this -> mass + bodyptr -> mass;
+
+    if(this -> inplace || bodyptr -> inplace)
+    {
+        if(!this -> inplace)
+        {
+            this -> position = bodyptr -> position;
+        }
+        this -> inplace = true;
+        this -> velocity = sf::Vector2<double>{0, 0};
+    }
+    else if(total_mass > 0)
+    {
+        this -> position = (this -> position * this -> mass + bodyptr -> position * bodyptr -> mass) / total_mass;
+        this -> velocity = (this -> velocity * this -> mass + bodyptr -> velocity * bodyptr -> mass) / total_mass;
+    }
+
+    this -> radius = static_cast<int>(std::lround(sqrt(pow(this -> radius, 2) + pow(bodyptr -> radius, 2))));
+    this -> mass = total_mass;
 }
 
+
 /**
- * @brief Function to call to initiate updating of velocity given 
- *        a vector of other bodies exerting a force on this body and
- *        a small time segment. Uses naive method.
- * 
- * @param bodies Vector containing other bodies exerting a force on this body.
- * @param dt Time segment (time since last frame update) in seconds.
+ * @brief Moves the body back inside the window if it has left it.
  */
-void body::update_velocity(const std::vector<body*>& bodies, double dt)
+void body::keep_in_bounds()
 {
     if(position.x < 0 || position.x > settings::DIMENSIONS.first)
     {
-        velocity = sf::Vector2<double>{-velocity.x, velocity.y};
+        if(position.x < 0)
+        {
+            position = sf::Vector2<double>{radius * 1.0, position.y};
+        }
+        if(position.x > settings::DIMENSIONS.first)
+        {
+            position = sf::Vector2<double>{settings::DIMENSIONS.first - radius * 1.0, position.y};
+        }
+
     }
     if(position.y < 0 || position.y > settings::DIMENSIONS.second)
     {
-        velocity = sf::Vector2<double>{velocity.x, -velocity.y};
+        if(position.y < 0)
+        {
+            position = sf::Vector2<double>{position.x, radius * 1.0};
+        }
+        if(position.y > settings::DIMENSIONS.second)
+        {
+            position = sf::Vector2<double>{position.x, settings::DIMENSIONS.second - radius * 1.0};
+        }
     }
-
-    update_acceleration(bodies);
-    increment_velocity(dt);
-    
 }
 
 /**
- * @brief Function to call to initiate updating of velocity using the 
- *        Barnes Hut approximation method.
- * 
- * @param body_tree Barnes Hut quadtree containing the bodies in the sim.
- * @param dt Time segment (time since last frame update) in seconds.
+ * @brief Reverses the velocity components of the body that point out of the window once it has left it.
  */
-void body::update_velocity_barnes_hut(const b_h_tree& body_tree, double dt)
+void body::reflect_at_bounds()
 {
-
     if(position.x < 0 || position.x > settings::DIMENSIONS.first)
     {
         velocity = sf::Vector2<double>{-velocity.x, velocity.y};
@@ -227,46 +285,29 @@ void body::update_velocity_barnes_hut(const b_h_tree& body_tree, double dt)
     {
         velocity = sf::Vector2<double>{velocity.x, -velocity.y};
     }
-    update_acceleration_barnes_hut(body_tree);
-    increment_velocity(dt);
-
 }
 
 /**
- * @brief Function to call to initiate updating of acceleration given 
- *        a vector of other bodies exerting a force on this body and
- *        a small time segment. Uses naive method.
+ * @brief Increments the position of the body given some 
+ *        time segment and velocity.
  * 
- * @param bodies Vector containing other bodies exerting a force on this body.
+ * @param dt Time segment from last frame in seconds.
  */
-void body::update_acceleration(const std::vector<body*>& bodies)
+void body::increment_position(double dt)
 {
-    sf::Vector2<double> new_acceleration{0, 0};
-    for(const body* element : bodies)
-    {
-
-        if(element != this)
-        {
-        sf::Vector2<double> a_vector = calc_accel(element);
-        new_acceleration = new_acceleration + a_vector;
-        }
-
-    }
-
-    acceleration = new_acceleration;
-    
+    sf::Vector2<double> delta_x = velocity * dt;
+    position = position + delta_x;
 }
 
 /**
- * @brief Function to call to initiate updating of acceleration using the 
- *        Barnes Hut approximation method.
+ * @brief Increments the velocity of the body given some 
+ *        time segment and acceleration.
  * 
- * @param body_tree Barnes Hut quadtree containing the bodies in the sim.
+ * @param dt Time segment (time since last frame update) in seconds.
  */
-void body::update_acceleration_barnes_hut(const b_h_tree& body_tree)
+void body::increment_velocity(double dt)
 {
-   
-    acceleration = body_tree.get_accel(this);
-    
+    sf::Vector2<double> delta_v = acceleration * dt;
+    velocity = velocity + delta_v;
 }
 
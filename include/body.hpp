@@ -5,10 +5,58 @@
 #include <vector>
 #include <cmath>
 #include <iostream>
-#include <SFML/Graphics.hpp>
-#include <barnes_hut_tree.hpp>
+#include <SFML/System/Vector2.hpp>
 
-  class b_h_tree;
+  /**
+   * @brief Raw gravity kernel shared by every solver. Gives the acceleration induced by a point mass at offset
+   *        delta from the accelerated body. The distance is clamped to reach (the sum of both radii) so
+   *        overlapping bodies feel a finite attraction of constant magnitude G * mass / reach^2 towards each
+   *        other. Coincident bodies have no direction to attract along and feel no force.
+   *
+   * @param delta_x Offset of the source from the accelerated body along x.
+   * @param delta_y Offset of the source from the accelerated body along y.
+   * @param reach Distance below which the force stops growing.
+   * @param mass Mass of the source.
+   * @return sf::Vector2<double> The acceleration induced by the source.
+   */
+  inline sf::Vector2<double> gravity_kernel(double delta_x, double delta_y, double reach, double mass)
+  {
+    double dist_mag = std::sqrt(delta_x * delta_x + delta_y * delta_y);
+
+    if(dist_mag == 0)
+    {
+      return sf::Vector2<double>{0, 0};
+    }
+
+    double clamped = dist_mag > reach ? dist_mag : reach;
+
+    double scale = settings::G * mass / (clamped * clamped * dist_mag);
+
+    return sf::Vector2<double>{delta_x * scale, delta_y * scale};
+  }
+
+  /**
+   * @brief Potential matching gravity_kernel(): -G * mass / distance beyond reach, and inside reach the potential of
+   *        the constant clamped force, so that its gradient is the force applied by the solvers. It is continuous
+   *        down to coincident bodies, where it reaches its minimum of -2 * G * mass / reach and the force vanishes.
+   *
+   * @param delta_x Offset of the source from the body along x.
+   * @param delta_y Offset of the source from the body along y.
+   * @param reach Distance below which the force stops growing.
+   * @param mass Mass of the source.
+   * @return double The potential per unit mass induced by the source.
+   */
+  inline double potential_kernel(double delta_x, double delta_y, double reach, double mass)
+  {
+    double dist_mag = std::sqrt(delta_x * delta_x + delta_y * delta_y);
+
+    if(dist_mag >= reach)
+    {
+      return dist_mag > 0 ? -settings::G * mass / dist_mag : 0;
+    }
+
+    return settings::G * mass * (dist_mag - 2 * reach) / (reach * reach);
+  }
 
   /**
    * @brief  The Body object represents a body that is influenced by gravitational forces.
@@ -41,42 +89,43 @@
 
      
       sf::Vector2<double> get_position();
+
+      sf::Vector2<double> get_velocity();
+
+      bool is_inplace();
+
+      const double& mass_ref() const;
+
+      const sf::Vector2<double>& position_ref() const;
+
+      const sf::Vector2<double>& velocity_ref() const;
+
+      const sf::Vector2<double>& acceleration_ref() const;
      
       
-      void update_position(const std::vector<body*>& bodies, double dt);
+      void drift(double dt);
 
-      void update_position_barnes_hut(const b_h_tree& body_tree, double dt);
+      void kick(sf::Vector2<double> accel, double dt);
       
       sf::Vector2<double> calc_accel(const body* bodyptr);
+
+      bool overlaps(const body* bodyptr);
+
+      void bounce(body* bodyptr);
+
+      void absorb(const body* bodyptr);
       
      private:
 
+      void keep_in_bounds();
+
+      void reflect_at_bounds();
       
       void increment_position(double dt);
       
 
       
       void increment_velocity(double dt);
-      
-      
-     
-      void update_velocity(const std::vector<body*>& bodies, double dt);
-      
-      void update_velocity_barnes_hut(const b_h_tree& body_tree, double dt);
-      
-      void update_acceleration(const std::vector<body*>& bodies);
-      
-      void update_acceleration_barnes_hut(const b_h_tree& body_tree);
-
-      void update_acceleration_brute_force(const std::vector<body*>& bodies);
-      
-
-      void update_acceleration_b_h(const std::vector<body*>& bodies);
-      
-
-
-
-      
 
   };
 
@@ -0,0 +1,171 @@
+#include <collision.hpp>
+#include <parallel.hpp>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+/**
+ * @brief Hashes integer cell coordinates to a bucket of the table.
+*/
+size_t simulation::collision_grid::bucket_of(std::int64_t cell_x, std::int64_t cell_y) const
+{
+    std::uint64_t hash = static_cast<std::uint64_t>(cell_x) * 73856093ULL ^ static_cast<std::uint64_t>(cell_y) * 19349663ULL;
+
+    return static_cast<size_t>(hash) & table_mask;
+}
+
+/**
+ * @brief Gets the cell coordinate containing a position coordinate.
+*/
+std::int64_t simulation::collision_grid::cell_of(double coordinate) const
+{
+    return static_cast<std::int64_t>(std::floor(coordinate / cell_size));
+}
+
+/**
+ * @brief Rebuilds the grid for the current positions of the bodies. The cell size is the largest body diameter,
+ *        so any two overlapping bodies lie in the same or in adjacent cells.
+ *
+ * @param bodies The bodies in the sim.
+*/
+void simulation::collision_grid::rebuild(const std::vector<body*>& bodies)
+{
+    int max_radius = 0;
+    for(body* b : bodies)
+    {
+        max_radius = std::max(max_radius, b -> get_radius());
+    }
+    cell_size = std::max(1, 2 * max_radius);
+
+    size_t table_size = 1;
+    while(table_size < 2 * bodies.size())
+    {
+        table_size <<= 1;
+    }
+    table_mask = table_size - 1;
+
+    body_bucket.resize(bodies.size());
+
+    parallel_for(0, bodies.size(), [&](size_t i)
+    {
+        sf::Vector2<double> pos = bodies[i] -> get_position();
+        body_bucket[i] = static_cast<std::uint32_t>(bucket_of(cell_of(pos.x), cell_of(pos.y)));
+    });
+
+    bucket_start.assign(table_size + 1, 0);
+    for(std::uint32_t bucket : body_bucket)
+    {
+        ++bucket_start[bucket + 1];
+    }
+    std::partial_sum(bucket_start.begin(), bucket_start.end(), bucket_start.begin());
+
+    std::vector<std::uint32_t> fill(bucket_start.begin(), bucket_start.end() - 1);
+    entries.resize(bodies.size());
+    for(size_t i = 0; i < bodies.size(); ++i)
+    {
+        entries[fill[body_bucket[i]]++] = static_cast<std::uint32_t>(i);
+    }
+}
+
+/**
+ * @brief Finds every pair of overlapping bodies. The queries run in parallel, each pair is reported once as
+ *        (lower index, higher index) and the pairs are ordered by their lower index.
+ *
+ * @param bodies The bodies in the sim, in the same order as when the grid was rebuilt.
+ * @return std::vector<std::pair<size_t, size_t>> The overlapping pairs.
+*/
+std::vector<std::pair<size_t, size_t>> simulation::collision_grid::find_overlaps(const std::vector<body*>& bodies) const
+{
+    std::vector<std::vector<std::pair<size_t, size_t>>> block_pairs(worker_count());
+
+    parallel_for_blocks(0, bodies.size(), [&](size_t block_begin, size_t block_end, size_t worker)
+    {
+        std::vector<std::pair<size_t, size_t>>& pairs = block_pairs[worker];
+
+        for(size_t i = block_begin; i < block_end; ++i)
+        {
+            sf::Vector2<double> pos = bodies[i] -> get_position();
+            std::int64_t cell_x = cell_of(pos.x);
+            std::int64_t cell_y = cell_of(pos.y);
+
+            size_t neighbours[9];
+            size_t num_neighbours = 0;
+
+            for(std::int64_t dx = -1; dx <= 1; ++dx)
+            {
+                for(std::int64_t dy = -1; dy <= 1; ++dy)
+                {
+                    size_t bucket = bucket_of(cell_x + dx, cell_y + dy);
+
+                    if(std::find(neighbours, neighbours + num_neighbours, bucket) == neighbours + num_neighbours)
+                    {
+                        neighbours[num_neighbours++] = bucket;
+                    }
+                }
+            }
+
+            for(size_t n = 0; n < num_neighbours; ++n)
+            {
+                for(std::uint32_t e = bucket_start[neighbours[n]]; e < bucket_start[neighbours[n] + 1]; ++e)
+                {
+                    size_t j = entries[e];
+
+                    if(j > i && bodies[i] -> overlaps(bodies[j]))
+                    {
+                        pairs.emplace_back(i, j);
+                    }
+                }
+            }
+        }
+    });
+
+    std::vector<std::pair<size_t, size_t>> overlaps;
+    for(std::vector<std::pair<size_t, size_t>>& pairs : block_pairs)
+    {
+        overlaps.insert(overlaps.end(), pairs.begin(), pairs.end());
+    }
+
+    return overlaps;
+}
+
+/**
+ * @brief Groups bodies connected by overlapping pairs (a union-find over the pairs) for inelastic merging.
+ *
+ * @param pairs The overlapping pairs found by the broad phase.
+ * @param num_bodies Number of bodies in the sim.
+ * @return std::vector<size_t> For every body, the lowest index of its group. Bodies whose entry differs from their
+ *         own index are absorbed into that body.
+*/
+std::vector<size_t> simulation::merge_targets(const std::vector<std::pair<size_t, size_t>>& pairs, size_t num_bodies)
+{
+    std::vector<size_t> parent(num_bodies);
+    std::iota(parent.begin(), parent.end(), 0);
+
+    auto find = [&parent](size_t i)
+    {
+        while(parent[i] != i)
+        {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+        return i;
+    };
+
+    for(const std::pair<size_t, size_t>& pair : pairs)
+    {
+        size_t root_a = find(pair.first);
+        size_t root_b = find(pair.second);
+
+        if(root_a != root_b)
+        {
+            parent[std::max(root_a, root_b)] = std::min(root_a, root_b);
+        }
+    }
+
+    for(size_t i = 0; i < num_bodies; ++i)
+    {
+        parent[i] = find(i);
+    }
+
+    return parent;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <body.hpp>
+
+namespace simulation
+{
+    /**
+     * @brief How overlapping bodies are resolved by the collision stage. With none, overlapping bodies pass through
+     *        each other under a constant attraction of G * m / reach^2 (reach being the sum of their radii), only
+     *        vanishing when they coincide; before the force was clamped, its sign flipped as they overlapped.
+    */
+    enum class collision_mode
+    {
+        none,
+        elastic,
+        merge
+    };
+
+    /**
+     * @brief The collision_grid object is a uniform spatial hash grid used as the broad phase of the collision stage.
+     *        It is rebuilt from scratch every step in O(N) with a counting sort, and overlapping pairs are found by
+     *        only testing each body against the bodies hashed to the 3x3 block of cells around it.
+    */
+    class collision_grid
+    {
+        private:
+            double cell_size{1};
+            size_t table_mask{};
+            std::vector<std::uint32_t> bucket_start;
+            std::vector<std::uint32_t> entries;
+            std::vector<std::uint32_t> body_bucket;
+
+            size_t bucket_of(std::int64_t cell_x, std::int64_t cell_y) const;
+
+            std::int64_t cell_of(double coordinate) const;
+
+        public:
+
+            void rebuild(const std::vector<body*>& bodies);
+
+            std::vector<std::pair<size_t, size_t>> find_overlaps(const std::vector<body*>& bodies) const;
+    };
+
+    std::vector<size_t> merge_targets(const std::vector<std::pair<size_t, size_t>>& pairs, size_t num_bodies);
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+
+namespace simulation
+{
+    /**
+     * @brief The counter_rng object is a counter-based random number generator. Every draw is a pure function of
+     *        (seed, stream, counter), so each body can draw its own numbers on any thread and a run started from
+     *        the same seed is reproducible regardless of how the work was split.
+    */
+    class counter_rng
+    {
+        private:
+            std::uint64_t key{};
+            std::uint64_t counter{};
+
+            /**
+             * @brief Bijective 64 bit mixing function (the splitmix64 finalizer).
+            */
+            static std::uint64_t mix(std::uint64_t z)
+            {
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+                return z ^ (z >> 31);
+            }
+
+        public:
+
+            /**
+             * @brief Construct a new counter_rng object.
+             *
+             * @param seed Seed of the whole run.
+             * @param stream Independent stream within the run, typically the index of the body being generated.
+            */
+            counter_rng(std::uint64_t seed, std::uint64_t stream)
+            : key{mix(seed ^ mix(stream + 0x9e3779b97f4a7c15ULL))}
+            {}
+
+            /**
+             * @brief Gets the next 64 random bits of this stream.
+            */
+            std::uint64_t next()
+            {
+                return mix(key + 0x9e3779b97f4a7c15ULL * ++counter);
+            }
+
+            /**
+             * @brief Gets a uniformly distributed double in the open interval (0, 1).
+            */
+            double uniform()
+            {
+                return ((next() >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+            }
+
+            /**
+             * @brief Gets a uniformly distributed double in [low, high).
+            */
+            double uniform(double low, double high)
+            {
+                return low + (high - low) * uniform();
+            }
+    };
+}
@@ -0,0 +1,176 @@
+#include <diagnostics.hpp>
+#include <barnes_hut_tree.hpp>
+#include <task_scheduler.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+    /**
+     * @brief Number of bodies summed by one task of the reductions. Partial sums are kept per block and added in
+     *        block order, so the result does not depend on the thread count.
+    */
+    const size_t REDUCTION_BLOCK = 4096;
+
+    /**
+     * @brief Partial sums of one block of bodies.
+    */
+    struct partial_sums
+    {
+        double kinetic{};
+        double potential{};
+        double momentum_x{};
+        double momentum_y{};
+        double angular_momentum{};
+    };
+}
+
+/**
+ * @brief Construct a new diagnostics object.
+ *
+ * @param _interval Number of steps between two measurements.
+ * @param path File receiving the CSV rows, empty to write them to the standard output.
+ * @param _opening_angle Opening angle of the tree computing the potential energy. Angles that are not positive would
+ *        open every cell and turn the walk into a direct sum, so they fall back to settings::RATIO_EPSILON.
+ * @param _leaf_size Maximum number of bodies per leaf of that tree.
+*/
+simulation::diagnostics::diagnostics(size_t _interval, const std::string& path, double _opening_angle, size_t _leaf_size)
+: interval{std::max<size_t>(1, _interval)}, opening_angle{_opening_angle > 0 ? _opening_angle : settings::RATIO_EPSILON}, leaf_size{_leaf_size}, out{&std::cout}
+{
+    if(!path.empty())
+    {
+        file = std::make_unique<std::ofstream>(path);
+        out = file.get();
+    }
+}
+
+/**
+ * @brief Determines whether the quantities should be measured after a step.
+ *
+ * @param step Number of steps taken so far.
+ * @return bool True once every interval steps.
+*/
+bool simulation::diagnostics::due(size_t step) const
+{
+    return step % interval == 0;
+}
+
+/**
+ * @brief Measures the conserved quantities of a set of bodies. Inplace bodies hold still, so they add potential
+ *        energy but neither kinetic energy nor momentum.
+ *
+ * @param bodies The bodies being measured.
+ * @param step Number of steps taken so far.
+ * @param time Simulated time so far.
+ * @param scheduler Scheduler running the tree walks and the reductions, or nullptr to run them on the calling thread.
+ * @param spill_directory Directory backing the tree's arrays in out-of-core runs, or nullptr.
+ * @return const conserved_quantities& The measurement, also returned by get_latest() until the next one.
+*/
+const simulation::conserved_quantities& simulation::diagnostics::measure(const std::vector<body*>& bodies, size_t step, double time, task_scheduler* scheduler, std::shared_ptr<const std::string> spill_directory)
+{
+    b_h_tree body_tree{bodies, scheduler, opening_angle, leaf_size, spill_directory};
+
+    size_t num_blocks = (bodies.size() + REDUCTION_BLOCK - 1) / REDUCTION_BLOCK;
+    std::vector<partial_sums> partials(num_blocks);
+
+    auto reduce_blocks = [&body_tree, &bodies, &partials](size_t first_block, size_t last_block)
+    {
+        for(size_t block = first_block; block < last_block; ++block)
+        {
+            partial_sums& sums = partials[block];
+            size_t block_end = std::min(bodies.size(), (block + 1) * REDUCTION_BLOCK);
+
+            for(size_t i = block * REDUCTION_BLOCK; i < block_end; ++i)
+            {
+                body* b = bodies[i];
+                double mass = b -> get_mass();
+
+                sums.potential += 0.5 * mass * body_tree.get_potential(b);
+
+                if(b -> is_inplace())
+                {
+                    continue;
+                }
+
+                sf::Vector2<double> position = b -> get_position();
+                sf::Vector2<double> velocity = b -> get_velocity();
+
+                sums.kinetic += 0.5 * mass * (velocity.x * velocity.x + velocity.y * velocity.y);
+                sums.momentum_x += mass * velocity.x;
+                sums.momentum_y += mass * velocity.y;
+                sums.angular_momentum += mass * (position.x * velocity.y - position.y * velocity.x);
+            }
+        }
+    };
+
+    if(scheduler != nullptr)
+    {
+        scheduler -> parallel_for(0, num_blocks, 1, reduce_blocks);
+    }
+    else
+    {
+        reduce_blocks(0, num_blocks);
+    }
+
+    latest = conserved_quantities{};
+    latest.step = step;
+    latest.time = time;
+
+    for(const partial_sums& sums : partials)
+    {
+        latest.kinetic += sums.kinetic;
+        latest.potential += sums.potential;
+        latest.momentum.x += sums.momentum_x;
+        latest.momentum.y += sums.momentum_y;
+        latest.angular_momentum += sums.angular_momentum;
+    }
+
+    latest.total = latest.kinetic + latest.potential;
+
+    if(!has_reference)
+    {
+        reference = latest;
+        has_reference = true;
+    }
+
+    return latest;
+}
+
+/**
+ * @brief Writes a measurement as a CSV row, after the header row for the first one.
+ *
+ * @param quantities The measurement, usually the one just returned by measure().
+*/
+void simulation::diagnostics::record(const conserved_quantities& quantities)
+{
+    if(!header_written)
+    {
+        *out << "step,time,kinetic,potential,total,energy_drift,momentum_x,momentum_y,angular_momentum\n";
+        header_written = true;
+    }
+
+    *out << quantities.step << ',' << quantities.time << ',' << quantities.kinetic << ',' << quantities.potential << ','
+         << quantities.total << ',' << energy_drift() << ',' << quantities.momentum.x << ',' << quantities.momentum.y << ','
+         << quantities.angular_momentum << std::endl;
+}
+
+/**
+ * @brief Gets the drift of the total energy of the latest measurement relative to the first one.
+ *
+ * @return double |E - E0| / |E0|, or |E - E0| when E0 is zero.
+*/
+double simulation::diagnostics::energy_drift() const
+{
+    double drift = std::abs(latest.total - reference.total);
+
+    return reference.total != 0 ? drift / std::abs(reference.total) : drift;
+}
+
+/**
+ * @brief Gets the latest measurement.
+*/
+const simulation::conserved_quantities& simulation::diagnostics::get_latest() const
+{
+    return latest;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <SFML/System/Vector2.hpp>
+#include <body.hpp>
+#include <settings.hpp>
+
+namespace simulation
+{
+    class task_scheduler;
+
+    /**
+     * @brief The quantities conserved by an isolated system, measured at one step.
+    */
+    struct conserved_quantities
+    {
+        size_t step{};
+        double time{};
+        double kinetic{};
+        double potential{};
+        double total{};
+        sf::Vector2<double> momentum{};
+        double angular_momentum{};
+    };
+
+    /**
+     * @brief The diagnostics object monitors conservation during a run. Every interval steps it measures the kinetic
+     *        energy, the momentum and the angular momentum (about the origin) as parallel reductions over the bodies,
+     *        and the potential energy through a Barnes Hut tree walked like the force solver, so a measurement costs
+     *        about one step and the overhead of the monitor is about 1 / interval. Each measurement is written as a
+     *        CSV row together with the relative drift of the total energy since the first one.
+    */
+    class diagnostics
+    {
+        private:
+            size_t interval{};
+            double opening_angle{};
+            size_t leaf_size{};
+            std::unique_ptr<std::ofstream> file;
+            std::ostream* out{};
+            bool header_written{};
+            bool has_reference{};
+            conserved_quantities reference{};
+            conserved_quantities latest{};
+
+        public:
+
+            diagnostics(size_t _interval = 100, const std::string& path = "", double _opening_angle = settings::RATIO_EPSILON, size_t _leaf_size = 8);
+
+            bool due(size_t step) const;
+
+            const conserved_quantities& measure(const std::vector<body*>& bodies, size_t step, double time, task_scheduler* scheduler = nullptr, std::shared_ptr<const std::string> spill_directory = nullptr);
+
+            void record(const conserved_quantities& quantities);
+
+            double energy_drift() const;
+
+            const conserved_quantities& get_latest() const;
+    };
+}
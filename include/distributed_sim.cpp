@@ -0,0 +1,437 @@
+#include <distributed_sim.hpp>
+#include <settings.hpp>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+namespace
+{
+    const size_t SAMPLES_PER_RANK = 1024;
+
+    /**
+     * @brief Gets the distance from a point to the nearest point of a domain, 0 if the point is inside it.
+    */
+    double distance_to_domain(sf::Vector2<double> point, const simulation::distributed_sim::domain& box)
+    {
+        double dx = std::max({box.low.x - point.x, 0.0, point.x - box.high.x});
+        double dy = std::max({box.low.y - point.y, 0.0, point.y - box.high.y});
+
+        return std::sqrt(dx * dx + dy * dy);
+    }
+
+    /**
+     * @brief Collects the part of a local tree that another rank needs to compute forces on the bodies inside its
+     *        domain: cells that are far enough from the domain become a single center-of-mass ghost, bodies in
+     *        cells that have to be opened are sent as they are. The cell is tested against the nearest point of the
+     *        domain with the opening angle of the receiving walk, so every body of the domain would accept it too.
+    */
+    void collect_essential(const std::shared_ptr<b_h_tree::b_h_node>& node, const simulation::distributed_sim::domain& box, double opening_angle, std::vector<simulation::packed_body>& ghosts)
+    {
+        if(node -> is_external())
+        {
+            for(size_t i = 0; i < node -> leaf_count; ++i)
+            {
+                simulation::packed_body ghost = simulation::pack(node -> leaf_bodies[i]);
+                ghost.inplace = 1;
+                ghosts.push_back(ghost);
+            }
+        }
+        else if(node -> is_internal())
+        {
+            double distance = distance_to_domain(node -> center_of_mass, box);
+
+            if(distance > 0 && node -> width / distance < opening_angle)
+            {
+                ghosts.push_back(simulation::packed_body{node -> total_mass, 0, 1, node -> center_of_mass.x, node -> center_of_mass.y, 0, 0});
+            }
+            else
+            {
+                for(const std::shared_ptr<b_h_tree::b_h_node>& child : node -> children)
+                {
+                    collect_essential(child, box, opening_angle, ghosts);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Construct a new distributed_sim object. MPI must already be initialized. Packed bodies travel as an MPI type
+ *        of their own, so exchanges count bodies rather than bytes and stay within MPI's int counts far longer.
+ *
+ * @param _comm Communicator holding the ranks that share the simulation.
+ * @param _opening_angle Opening angle of the local walks, also used to pick the cells exported as ghosts.
+ * @param num_threads Number of threads this rank builds and walks its trees with.
+*/
+simulation::distributed_sim::distributed_sim(MPI_Comm _comm, double _opening_angle, size_t num_threads)
+: comm{_comm}, opening_angle{_opening_angle}, scheduler{std::make_unique<task_scheduler>(num_threads)}
+{
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &num_ranks);
+
+    MPI_Type_contiguous(static_cast<int>(sizeof(packed_body) / sizeof(double)), MPI_DOUBLE, &body_type);
+    MPI_Type_commit(&body_type);
+
+    domains.resize(num_ranks);
+}
+
+/**
+ * @brief Releases the MPI type of the packed bodies. MPI must not be finalized yet.
+*/
+simulation::distributed_sim::~distributed_sim()
+{
+    MPI_Type_free(&body_type);
+}
+
+/**
+ * @brief Distributes the initial bodies across the ranks.
+ *
+ * @param bodies All bodies of the simulation on rank 0, ignored on the other ranks.
+*/
+void simulation::distributed_sim::scatter(const std::vector<body>& bodies)
+{
+    if(rank == 0)
+    {
+        local_bodies = bodies;
+    }
+
+    decompose();
+    migrate();
+}
+
+/**
+ * @brief Collects every body of the simulation on rank 0, for output or recording.
+ *
+ * @param bodies Receives all bodies on rank 0, left untouched on the other ranks.
+*/
+void simulation::distributed_sim::gather(std::vector<body>& bodies) const
+{
+    std::vector<packed_body> packed(local_bodies.size());
+    for(size_t i = 0; i < local_bodies.size(); ++i)
+    {
+        packed[i] = pack(const_cast<body*>(&local_bodies[i]));
+    }
+
+    int send_count = static_cast<int>(packed.size());
+    std::vector<int> recv_counts(num_ranks);
+    MPI_Gather(&send_count, 1, MPI_INT, recv_counts.data(), 1, MPI_INT, 0, comm);
+
+    std::vector<int> displacements(num_ranks);
+    int total = 0;
+    for(int r = 0; r < num_ranks; ++r)
+    {
+        displacements[r] = total;
+        total += recv_counts[r];
+    }
+
+    std::vector<packed_body> all(rank == 0 ? total : 0);
+    MPI_Gatherv(packed.data(), send_count, body_type, all.data(), recv_counts.data(), displacements.data(), body_type, 0, comm);
+
+    if(rank == 0)
+    {
+        bodies.clear();
+        bodies.reserve(all.size());
+        for(const packed_body& record : all)
+        {
+            bodies.push_back(unpack(record));
+        }
+    }
+}
+
+/**
+ * @brief Advances the simulation by one step on every rank. Must be called collectively.
+ *
+ * @param dt Time segment of the step in seconds.
+*/
+void simulation::distributed_sim::step(double dt)
+{
+    for(body& b : local_bodies)
+    {
+        b.drift(dt);
+    }
+
+    decompose();
+    migrate();
+
+    std::vector<body*> local_ptrs(local_bodies.size());
+    for(size_t i = 0; i < local_bodies.size(); ++i)
+    {
+        local_ptrs[i] = &local_bodies[i];
+    }
+
+    b_h_tree local_tree{local_ptrs, scheduler.get(), opening_angle};
+
+    std::vector<body> ghosts = exchange_ghosts(local_tree);
+
+    std::vector<body*> all_ptrs = local_ptrs;
+    for(body& ghost : ghosts)
+    {
+        all_ptrs.push_back(&ghost);
+    }
+
+    b_h_tree full_tree{all_ptrs, scheduler.get(), opening_angle};
+
+    std::vector<sf::Vector2<double>> accels(local_bodies.size());
+
+    scheduler -> parallel_for(0, local_bodies.size(), 1024, [&](size_t block_begin, size_t block_end)
+    {
+        for(size_t i = block_begin; i < block_end; ++i)
+        {
+            accels[i] = full_tree.get_accel(local_ptrs[i]);
+        }
+    });
+
+    for(size_t i = 0; i < local_bodies.size(); ++i)
+    {
+        local_bodies[i].kick(accels[i], dt);
+    }
+}
+
+/**
+ * @brief Gets the number of bodies owned by this rank.
+*/
+size_t simulation::distributed_sim::num_local_bodies() const
+{
+    return local_bodies.size();
+}
+
+/**
+ * @brief Gets the rank of this process.
+*/
+int simulation::distributed_sim::get_rank() const
+{
+    return rank;
+}
+
+/**
+ * @brief Recomputes the ORB decomposition. Every rank contributes an evenly strided sample of its body positions,
+ *        the sample is shared with all ranks and each rank builds the same ORB tree from it, so no further
+ *        communication is needed to agree on the domains.
+*/
+void simulation::distributed_sim::decompose()
+{
+    unsigned long long local_count = local_bodies.size();
+    unsigned long long total_count = 0;
+    MPI_Allreduce(&local_count, &total_count, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, comm);
+
+    size_t stride = std::max<size_t>(1, total_count / (SAMPLES_PER_RANK * num_ranks));
+
+    std::vector<double> local_sample;
+    for(size_t i = 0; i < local_bodies.size(); i += stride)
+    {
+        sf::Vector2<double> position = local_bodies[i].get_position();
+        local_sample.push_back(position.x);
+        local_sample.push_back(position.y);
+    }
+
+    int send_count = static_cast<int>(local_sample.size());
+    std::vector<int> recv_counts(num_ranks);
+    MPI_Allgather(&send_count, 1, MPI_INT, recv_counts.data(), 1, MPI_INT, comm);
+
+    std::vector<int> displacements(num_ranks);
+    int total = 0;
+    for(int r = 0; r < num_ranks; ++r)
+    {
+        displacements[r] = total;
+        total += recv_counts[r];
+    }
+
+    std::vector<double> flat_sample(total);
+    MPI_Allgatherv(local_sample.data(), send_count, MPI_DOUBLE, flat_sample.data(), recv_counts.data(), displacements.data(), MPI_DOUBLE, comm);
+
+    std::vector<sf::Vector2<double>> sample(total / 2);
+    for(size_t i = 0; i < sample.size(); ++i)
+    {
+        sample[i] = sf::Vector2<double>{flat_sample[2 * i], flat_sample[2 * i + 1]};
+    }
+
+    orb_tree.clear();
+    build_orb(sample, 0, sample.size(), 0, num_ranks, domain{});
+}
+
+/**
+ * @brief Recursively bisects the sample, splitting the ranks in two at each level so that each half of the ranks
+ *        gets a share of the sample proportional to its number of ranks.
+ *
+ * @return int Index of the ORB node built for this range of ranks.
+*/
+int simulation::distributed_sim::build_orb(std::vector<sf::Vector2<double>>& sample, size_t first, size_t last, int first_rank, int last_rank, domain box)
+{
+    int index = static_cast<int>(orb_tree.size());
+    orb_tree.emplace_back();
+
+    if(last_rank - first_rank == 1)
+    {
+        orb_tree[index].rank = first_rank;
+        domains[first_rank] = box;
+        return index;
+    }
+
+    int left_ranks = (last_rank - first_rank) / 2;
+
+    int axis = 0;
+    double split = 0;
+
+    if(first < last)
+    {
+        auto [min_x, max_x] = std::minmax_element(sample.begin() + first, sample.begin() + last, [](auto a, auto b) { return a.x < b.x; });
+        auto [min_y, max_y] = std::minmax_element(sample.begin() + first, sample.begin() + last, [](auto a, auto b) { return a.y < b.y; });
+
+        axis = (max_x -> x - min_x -> x) >= (max_y -> y - min_y -> y) ? 0 : 1;
+
+        size_t middle = first + (last - first) * left_ranks / (last_rank - first_rank);
+        middle = std::min(middle, last - 1);
+
+        std::nth_element(sample.begin() + first, sample.begin() + middle, sample.begin() + last, [axis](auto a, auto b)
+        {
+            return axis == 0 ? a.x < b.x : a.y < b.y;
+        });
+
+        split = axis == 0 ? sample[middle].x : sample[middle].y;
+    }
+    else
+    {
+        double low = axis == 0 ? box.low.x : box.low.y;
+        double high = axis == 0 ? box.high.x : box.high.y;
+        split = std::isfinite(low) && std::isfinite(high) ? (low + high) / 2 : (std::isfinite(low) ? low : (std::isfinite(high) ? high : 0));
+    }
+
+    auto middle_it = std::partition(sample.begin() + first, sample.begin() + last, [axis, split](auto p)
+    {
+        return (axis == 0 ? p.x : p.y) < split;
+    });
+    size_t middle = middle_it - sample.begin();
+
+    domain left_box = box;
+    domain right_box = box;
+    (axis == 0 ? left_box.high.x : left_box.high.y) = split;
+    (axis == 0 ? right_box.low.x : right_box.low.y) = split;
+
+    orb_tree[index].axis = axis;
+    orb_tree[index].split = split;
+
+    int left = build_orb(sample, first, middle, first_rank, first_rank + left_ranks, left_box);
+    int right = build_orb(sample, middle, last, first_rank + left_ranks, last_rank, right_box);
+
+    orb_tree[index].left = left;
+    orb_tree[index].right = right;
+
+    return index;
+}
+
+/**
+ * @brief Gets the rank whose domain contains a position.
+*/
+int simulation::distributed_sim::owner(sf::Vector2<double> position) const
+{
+    int index = 0;
+
+    while(orb_tree[index].rank < 0)
+    {
+        const orb_node& node = orb_tree[index];
+        double coordinate = node.axis == 0 ? position.x : position.y;
+
+        index = coordinate < node.split ? node.left : node.right;
+    }
+
+    return orb_tree[index].rank;
+}
+
+/**
+ * @brief Sends every body that left this rank's domain to the rank that now owns it.
+*/
+void simulation::distributed_sim::migrate()
+{
+    std::vector<std::vector<packed_body>> outgoing(num_ranks);
+    std::vector<body> kept;
+    kept.reserve(local_bodies.size());
+
+    for(body& b : local_bodies)
+    {
+        int destination = owner(b.get_position());
+
+        if(destination == rank)
+        {
+            kept.push_back(b);
+        }
+        else
+        {
+            outgoing[destination].push_back(pack(&b));
+        }
+    }
+
+    std::vector<packed_body> incoming = exchange(outgoing);
+
+    for(const packed_body& record : incoming)
+    {
+        kept.push_back(unpack(record));
+    }
+
+    local_bodies.swap(kept);
+}
+
+/**
+ * @brief Sends every other rank the essential part of the local tree for its domain and returns the ghosts
+ *        received from the other ranks. Ghosts are held in place so they never move.
+*/
+std::vector<body> simulation::distributed_sim::exchange_ghosts(const b_h_tree& local_tree) const
+{
+    std::vector<std::vector<packed_body>> outgoing(num_ranks);
+
+    for(int r = 0; r < num_ranks; ++r)
+    {
+        if(r != rank)
+        {
+            collect_essential(local_tree.root, domains[r], opening_angle, outgoing[r]);
+        }
+    }
+
+    std::vector<packed_body> incoming = exchange(outgoing);
+
+    std::vector<body> ghosts;
+    ghosts.reserve(incoming.size());
+    for(const packed_body& record : incoming)
+    {
+        ghosts.push_back(unpack(record));
+    }
+
+    return ghosts;
+}
+
+/**
+ * @brief All-to-all exchange of packed bodies.
+ *
+ * @param outgoing outgoing[r] holds the records sent to rank r.
+ * @return std::vector<packed_body> The records received from all ranks, ordered by source rank.
+*/
+std::vector<simulation::packed_body> simulation::distributed_sim::exchange(const std::vector<std::vector<packed_body>>& outgoing) const
+{
+    std::vector<int> send_counts(num_ranks);
+    std::vector<int> send_displacements(num_ranks);
+    std::vector<packed_body> send_buffer;
+
+    for(int r = 0; r < num_ranks; ++r)
+    {
+        send_displacements[r] = static_cast<int>(send_buffer.size());
+        send_counts[r] = static_cast<int>(outgoing[r].size());
+        send_buffer.insert(send_buffer.end(), outgoing[r].begin(), outgoing[r].end());
+    }
+
+    std::vector<int> recv_counts(num_ranks);
+    MPI_Alltoall(send_counts.data(), 1, MPI_INT, recv_counts.data(), 1, MPI_INT, comm);
+
+    std::vector<int> recv_displacements(num_ranks);
+    int total = 0;
+    for(int r = 0; r < num_ranks; ++r)
+    {
+        recv_displacements[r] = total;
+        total += recv_counts[r];
+    }
+
+    std::vector<packed_body> recv_buffer(total);
+
+    MPI_Alltoallv(send_buffer.data(), send_counts.data(), send_displacements.data(), body_type,
+                  recv_buffer.data(), recv_counts.data(), recv_displacements.data(), body_type, comm);
+
+    return recv_buffer;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <vector>
+#include <mpi.h>
+#include <SFML/System/Vector2.hpp>
+#include <body.hpp>
+#include <barnes_hut_tree.hpp>
+#include <settings.hpp>
+#include <initial_conditions.hpp>
+#include <task_scheduler.hpp>
+
+namespace simulation
+{
+    /**
+     * @brief The distributed_sim class runs a Barnes Hut simulation split across MPI ranks. Space is divided with
+     *        orthogonal recursive bisection (ORB) so that every rank owns a box holding roughly the same number of
+     *        bodies. Each step every rank builds a b_h_tree of its own bodies, ships to every other rank the
+     *        "essential" part of that tree (single bodies near the other rank's box, center-of-mass ghosts for
+     *        distant cells), and then computes the accelerations of its bodies from a tree holding its bodies and
+     *        the ghosts it received. Bodies that drift into another rank's box migrate at the start of the next step.
+     *        Each rank runs its trees on a scheduler of its own with the number of threads given by the caller, so
+     *        several ranks sharing a node can split its cores instead of each spawning one thread per core.
+    */
+    class distributed_sim
+    {
+        public:
+
+            /**
+             * @brief Axis-aligned box owned by a rank. Outer boxes extend to infinity.
+            */
+            struct domain
+            {
+                sf::Vector2<double> low{-std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity()};
+
+                sf::Vector2<double> high{std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity()};
+            };
+
+        private:
+
+            /**
+             * @brief Node of the ORB tree. Inner nodes split space along an axis, leaves name the owning rank.
+            */
+            struct orb_node
+            {
+                int axis{};
+                double split{};
+                int left{-1};
+                int right{-1};
+                int rank{-1};
+            };
+
+            MPI_Comm comm;
+            MPI_Datatype body_type{};
+            int rank{};
+            int num_ranks{};
+            double opening_angle{};
+            std::unique_ptr<task_scheduler> scheduler;
+            std::vector<body> local_bodies;
+            std::vector<orb_node> orb_tree;
+            std::vector<domain> domains;
+
+            int build_orb(std::vector<sf::Vector2<double>>& sample, size_t first, size_t last, int first_rank, int last_rank, domain box);
+
+            void decompose();
+
+            void migrate();
+
+            std::vector<body> exchange_ghosts(const b_h_tree& local_tree) const;
+
+            int owner(sf::Vector2<double> position) const;
+
+            std::vector<packed_body> exchange(const std::vector<std::vector<packed_body>>& outgoing) const;
+
+        public:
+
+            distributed_sim(MPI_Comm _comm = MPI_COMM_WORLD, double _opening_angle = settings::RATIO_EPSILON, size_t num_threads = 1);
+
+            ~distributed_sim();
+
+            distributed_sim(const distributed_sim&) = delete;
+
+            distributed_sim& operator=(const distributed_sim&) = delete;
+
+            void scatter(const std::vector<body>& bodies);
+
+            void gather(std::vector<body>& bodies) const;
+
+            void step(double dt);
+
+            size_t num_local_bodies() const;
+
+            int get_rank() const;
+    };
+}
@@ -0,0 +1,663 @@
+#include <engine.hpp>
+#include <stdexcept>
+
+namespace
+{
+    /**
+     * @brief Throws unless out-of-core steps can stream with these settings: only the Barnes Hut walk is chunked, while
+     *        the other solvers, the collision grid and the autotuner's probes read every body at random.
+    */
+    void require_streamable(simulation::solver_type solver, simulation::collision_mode mode, bool autotuned)
+    {
+        if(solver != simulation::solver_type::barnes_hut)
+        {
+            throw std::invalid_argument("out-of-core runs need the Barnes Hut solver");
+        }
+
+        if(mode != simulation::collision_mode::none)
+        {
+            throw std::invalid_argument("out-of-core runs need collisions turned off");
+        }
+
+        if(autotuned)
+        {
+            throw std::invalid_argument("out-of-core runs cannot be autotuned");
+        }
+    }
+}
+
+/**
+ * @brief Construct an engine holding no bodies.
+ *
+ * @param _config The engine and parameters used to compute the accelerations.
+*/
+simulation::engine::engine(const solver_config& _config)
+: config{_config}, scheduler{std::make_unique<task_scheduler>(_config.num_threads, _config.pin_threads)}
+{
+    body_store = store_type(store_allocator());
+}
+
+/**
+ * @brief Construct an engine from plain arrays, as handed over by a host application.
+ *
+ * @param count Number of bodies.
+ * @param masses count masses.
+ * @param positions count interleaved x, y pairs.
+ * @param velocities count interleaved x, y pairs, or nullptr for bodies at rest.
+ * @param radii count radii, or nullptr for a radius of 1.
+ * @param _config The engine and parameters used to compute the accelerations.
+*/
+simulation::engine::engine(size_t count, const double* masses, const double* positions, const double* velocities, const int* radii, const solver_config& _config)
+: engine{_config}
+{
+    body_store.reserve(count);
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        sf::Vector2<double> velocity = velocities ? sf::Vector2<double>(velocities[2 * i], velocities[2 * i + 1]) : sf::Vector2<double>(0, 0);
+
+        body_store.emplace_back(masses[i], radii ? radii[i] : 1, false, sf::Vector2<double>(positions[2 * i], positions[2 * i + 1]), velocity);
+    }
+
+    refresh_bodies();
+}
+
+/**
+ * @brief Adds a body to the engine. Invalidates the state views.
+ *
+ * @param mass The mass of the body being added.
+ * @param radius The radius of the body being added.
+ * @param inplace Whether the body being added is in place.
+ * @param position The initial position of the body being added.
+ * @param velocity The initial velocity of the body being added.
+*/
+void simulation::engine::add_body(double mass, int radius, bool inplace, sf::Vector2<double> position, sf::Vector2<double> velocity)
+{
+    size_t capacity = body_store.capacity();
+
+    body_store.emplace_back(mass, radius, inplace, position, velocity);
+
+    if(body_store.capacity() != capacity)
+    {
+        refresh_bodies();
+    }
+    else
+    {
+        bodies.push_back(&body_store.back());
+    }
+}
+
+/**
+ * @brief Adds a batch of bodies, such as the output of load_csv() or generate(). Invalidates the state views.
+ *
+ * @param new_bodies The bodies to add.
+*/
+void simulation::engine::add_bodies(std::vector<body> new_bodies)
+{
+    body_store.insert(body_store.end(), new_bodies.begin(), new_bodies.end());
+
+    refresh_bodies();
+}
+
+/**
+ * @brief Reserves room for count bodies in total, so that adding them one by one does not move the store.
+ *
+ * @param count The number of bodies to make room for.
+*/
+void simulation::engine::reserve(size_t count)
+{
+    if(count > body_store.capacity())
+    {
+        body_store.reserve(count);
+        refresh_bodies();
+    }
+}
+
+/**
+ * @brief Advances the system by num_steps steps of dt. Each step drifts every body, computes the accelerations with
+ *        the current solver (retuning it first when the autotuner is due), kicks the velocities and resolves
+ *        collisions. Batching steps keeps a host application's per-step overhead to a single call.
+ *
+ * @param dt Length of one step in seconds.
+ * @param num_steps Number of steps to take.
+*/
+void simulation::engine::step(double dt, size_t num_steps)
+{
+    const size_t grain = 4096;
+
+    auto drift_block = [this, dt](size_t block_begin, size_t block_end)
+    {
+        for(size_t i = block_begin; i < block_end; ++i)
+        {
+            bodies[i] -> drift(dt);
+        }
+    };
+
+    auto kick_block = [this, dt](size_t block_begin, size_t block_end)
+    {
+        for(size_t i = block_begin; i < block_end; ++i)
+        {
+            bodies[i] -> kick(accels[i], dt);
+        }
+    };
+
+    for(size_t s = 0; s < num_steps; ++s)
+    {
+        if(spill_directory)
+        {
+            step_out_of_core(dt);
+        }
+        else
+        {
+            place_store();
+
+            if(scheduler -> is_pinned())
+            {
+                scheduler -> parallel_for_static(0, bodies.size(), drift_block);
+            }
+            else
+            {
+                scheduler -> parallel_for(0, bodies.size(), grain, drift_block);
+            }
+
+            retune();
+
+            compute_accels(config, bodies, accels, *scheduler, mesh, &lists);
+
+            if(scheduler -> is_pinned())
+            {
+                scheduler -> parallel_for_static(0, bodies.size(), kick_block);
+            }
+            else
+            {
+                scheduler -> parallel_for(0, bodies.size(), grain, kick_block);
+            }
+
+            resolve_collisions();
+        }
+
+        sim_time += dt;
+        ++steps_taken;
+
+        if(monitor && monitor -> due(steps_taken))
+        {
+            monitor -> record(monitor -> measure(bodies, steps_taken, sim_time, scheduler.get(), spill_directory));
+        }
+    }
+}
+
+/**
+ * @brief Sets the engine and parameters used by the following steps. The scheduler is restarted and the bodies
+ *        placed again if the thread count or pinning changes. Out-of-core runs only accept Barnes Hut.
+ *
+ * @param _config The new solver configuration.
+*/
+void simulation::engine::set_config(const solver_config& _config)
+{
+    if(spill_directory)
+    {
+        require_streamable(_config.solver, collisions, tuner != nullptr);
+    }
+
+    config = _config;
+    apply_thread_count();
+}
+
+/**
+ * @brief Gets the solver configuration used by the next step, as chosen by set_config() or the autotuner.
+*/
+const simulation::solver_config& simulation::engine::get_config() const
+{
+    return config;
+}
+
+/**
+ * @brief Sets how overlapping bodies are resolved. Defaults to collision_mode::elastic. Out-of-core runs only accept
+ *        collision_mode::none.
+ *
+ * @param mode The collision mode used by the following steps.
+*/
+void simulation::engine::set_collision_mode(collision_mode mode)
+{
+    if(spill_directory)
+    {
+        require_streamable(config.solver, mode, tuner != nullptr);
+    }
+
+    collisions = mode;
+}
+
+/**
+ * @brief Configures the particle mesh used by solver_type::particle_mesh.
+ *
+ * @param mesh_size Number of mesh cells along each side of the window, must be a power of two.
+ * @param scheme Mass assignment scheme (CIC or TSC).
+ * @param p3m True to add the direct-sum short-range correction.
+*/
+void simulation::engine::set_particle_mesh(size_t mesh_size, mass_assignment scheme, bool p3m)
+{
+    mesh = particle_mesh{mesh_size, scheme, p3m};
+}
+
+/**
+ * @brief Lets the autotuner pick the solver configuration of the following steps. Not available out of core.
+ *
+ * @param tolerance Largest relative RMS acceleration error accepted, compared with direct summation.
+ * @param retune_interval Number of steps between two tunings.
+ * @param log Stream told about every choice, or nullptr to tune silently.
+*/
+void simulation::engine::set_autotune(double tolerance, size_t retune_interval, std::ostream* log)
+{
+    if(spill_directory)
+    {
+        require_streamable(config.solver, collisions, true);
+    }
+
+    tuner = std::make_unique<autotuner>(tolerance, retune_interval, log);
+}
+
+/**
+ * @brief Measures the conserved quantities every interval steps and writes them as CSV rows. The potential energy is
+ *        computed by a tree of its own, opened at settings::RATIO_EPSILON with leaves of 8 bodies whatever the solver
+ *        of the steps is, so a measurement costs about as much as a Barnes Hut step.
+ *
+ * @param interval Number of steps between two measurements, 0 to stop measuring.
+ * @param path File receiving the rows, empty for the standard output.
+*/
+void simulation::engine::set_diagnostics(size_t interval, const std::string& path)
+{
+    if(interval == 0)
+    {
+        monitor.reset();
+        return;
+    }
+
+    monitor = std::make_unique<diagnostics>(interval, path);
+}
+
+/**
+ * @brief Measures the conserved quantities of the current state, whether or not diagnostics are emitted. The
+ *        measurement is taken by a probe of its own, opened like the monitor, so that it neither becomes the monitor's
+ *        energy reference nor its latest measurement; only the measurements due every interval steps do.
+ *
+ * @return conserved_quantities The energies and momenta of the bodies.
+*/
+simulation::conserved_quantities simulation::engine::measure()
+{
+    diagnostics probe{1, ""};
+    return probe.measure(bodies, steps_taken, sim_time, scheduler.get(), spill_directory);
+}
+
+/**
+ * @brief Moves the body store, and the trees of the following steps, into files of a directory so that runs larger
+ *        than memory page to disk instead of failing. Steps then stream through the bodies in chunks, reading the next
+ *        chunk ahead and retiring the finished one, and every resort_interval steps the store is rewritten in the
+ *        order of the tree's leaves so that a chunk of bodies and the leaf data they walk first stay adjacent.
+ *        Out-of-core Barnes Hut walks a new tree every step and ignores solver_config::list_margin. Only Barnes Hut
+ *        streams, so the mode requires it, collisions turned off and no autotuner, and throws std::invalid_argument
+ *        otherwise; the settings are checked again whenever they change while the mode is on.
+ *
+ * @param directory Directory of the backing files, preferably on a fast local disk. Empty to return to memory.
+ * @param chunk_bodies Number of bodies streamed at once.
+ * @param _resort_interval Number of steps between two spatial reorderings of the store.
+*/
+void simulation::engine::set_out_of_core(const std::string& directory, size_t chunk_bodies, size_t _resort_interval)
+{
+    if(!directory.empty())
+    {
+        require_streamable(config.solver, collisions, tuner != nullptr);
+    }
+
+    spill_directory = directory.empty() ? nullptr : std::make_shared<const std::string>(directory);
+    chunk_size = std::max<size_t>(1, chunk_bodies);
+    resort_interval = std::max<size_t>(1, _resort_interval);
+    steps_since_resort = resort_interval;
+
+    place_store();
+}
+
+/**
+ * @brief Gets the number of bodies.
+*/
+size_t simulation::engine::size() const
+{
+    return body_store.size();
+}
+
+/**
+ * @brief Gets the simulated time elapsed over all steps.
+*/
+double simulation::engine::get_time() const
+{
+    return sim_time;
+}
+
+/**
+ * @brief Gets the number of steps taken.
+*/
+size_t simulation::engine::get_steps() const
+{
+    return steps_taken;
+}
+
+/**
+ * @brief Gets the pointers to the bodies, in the order of the state views.
+*/
+const std::vector<body*>& simulation::engine::get_bodies() const
+{
+    return bodies;
+}
+
+/**
+ * @brief Gets a view of the mass of every body.
+*/
+simulation::strided_view<double> simulation::engine::masses() const
+{
+    return strided_view<double>{body_store.empty() ? nullptr : &body_store.front().mass_ref(), body_store.size(), sizeof(body)};
+}
+
+/**
+ * @brief Gets a view of the position of every body.
+*/
+simulation::strided_view<sf::Vector2<double>> simulation::engine::positions() const
+{
+    return strided_view<sf::Vector2<double>>{body_store.empty() ? nullptr : &body_store.front().position_ref(), body_store.size(), sizeof(body)};
+}
+
+/**
+ * @brief Gets a view of the velocity of every body.
+*/
+simulation::strided_view<sf::Vector2<double>> simulation::engine::velocities() const
+{
+    return strided_view<sf::Vector2<double>>{body_store.empty() ? nullptr : &body_store.front().velocity_ref(), body_store.size(), sizeof(body)};
+}
+
+/**
+ * @brief Gets a view of the acceleration applied to every body by the last step. Bodies held in place report zero.
+*/
+simulation::strided_view<sf::Vector2<double>> simulation::engine::accelerations() const
+{
+    return strided_view<sf::Vector2<double>>{body_store.empty() ? nullptr : &body_store.front().acceleration_ref(), body_store.size(), sizeof(body)};
+}
+
+/**
+ * @brief Restarts the scheduler if the configured thread count or pinning differs from the running one, then places
+ *        the body store for the new workers.
+*/
+void simulation::engine::apply_thread_count()
+{
+    if(scheduler -> num_threads() == config.num_threads && scheduler -> is_pinned() == config.pin_threads)
+    {
+        return;
+    }
+
+    scheduler = std::make_unique<task_scheduler>(config.num_threads, config.pin_threads);
+
+    place_store();
+}
+
+/**
+ * @brief Lets the autotuner pick a new configuration if it is due. Only the engine, opening angle, leaf size and
+ *        thread count are taken from the tuner; thread pinning and the list margin stay as set by the user.
+*/
+void simulation::engine::retune()
+{
+    if(tuner && tuner -> due())
+    {
+        const solver_config& tuned = tuner -> tune(bodies, mesh, *scheduler);
+
+        config.solver = tuned.solver;
+        config.opening_angle = tuned.opening_angle;
+        config.leaf_size = tuned.leaf_size;
+        config.num_threads = tuned.num_threads;
+
+        apply_thread_count();
+    }
+}
+
+/**
+ * @brief Copies the body store into memory from store_allocator() if it lives elsewhere: pages first touched by the
+ *        pinned workers, a spill file, or the heap. Pinned workers first touch the store split over its capacity but
+ *        walk it split over its size, so a pinned store is also copied once growth or merges have made the two
+ *        differ, bringing the pages back to the workers that use them.
+*/
+void simulation::engine::place_store()
+{
+    if(store_allocator() == body_store.get_allocator() && (!config.pin_threads || body_store.capacity() == body_store.size()))
+    {
+        return;
+    }
+
+    store_type placed(store_allocator());
+    placed.reserve(body_store.size());
+    placed.insert(placed.end(), body_store.begin(), body_store.end());
+
+    body_store = std::move(placed);
+
+    refresh_bodies();
+}
+
+/**
+ * @brief Gets the allocator of the body store: backed by a spill file in out-of-core mode, placed by the scheduler's
+ *        workers (on huge pages unless spilled) when the threads are pinned, a plain heap allocator otherwise.
+*/
+simulation::placed_allocator<body> simulation::engine::store_allocator() const
+{
+    return placed_allocator<body>{config.pin_threads ? scheduler.get() : nullptr, config.pin_threads && !spill_directory, spill_directory};
+}
+
+/**
+ * @brief Runs func(chunk_begin, chunk_end) over the body store one chunk at a time, asking for the next chunk to be
+ *        read while the current one is processed and retiring each chunk once done.
+ *
+ * @param func Callable invoked once per chunk.
+*/
+template <typename F>
+void simulation::engine::stream(const F& func)
+{
+    size_t count = body_store.size();
+
+    for(size_t first = 0; first < count; first += chunk_size)
+    {
+        size_t last = std::min(count, first + chunk_size);
+        size_t next_last = std::min(count, last + chunk_size);
+
+        if(next_last > last)
+        {
+            prefetch_range(body_store.data() + last, body_store.data() + next_last);
+        }
+
+        func(first, last);
+
+        retire_range(body_store.data() + first, body_store.data() + last);
+    }
+}
+
+/**
+ * @brief Takes one step in out-of-core mode. Drift streams through the body store. The tree is then built in spill
+ *        files and the bodies are walked chunk by chunk, prefetching the leaf data of the next chunk, which with the
+ *        store in leaf order is the data that chunk's walks touch most. Each chunk is kicked right after its walk,
+ *        which is safe since walks read the sources from the tree's leaf arrays rather than from the bodies, so the
+ *        accelerations only need a buffer of one chunk.
+ *
+ * @param dt Length of the step in seconds.
+*/
+void simulation::engine::step_out_of_core(double dt)
+{
+    const size_t grain = 4096;
+
+    stream([this, dt, grain](size_t first, size_t last)
+    {
+        scheduler -> parallel_for(first, last, grain, [this, dt](size_t block_begin, size_t block_end)
+        {
+            for(size_t i = block_begin; i < block_end; ++i)
+            {
+                bodies[i] -> drift(dt);
+            }
+        });
+    });
+
+    b_h_tree body_tree{bodies, scheduler.get(), config.opening_angle, config.leaf_size, spill_directory};
+
+    accels.resize(std::min(chunk_size, bodies.size()));
+    accels.shrink_to_fit();
+
+    stream([this, &body_tree, dt, grain](size_t first, size_t last)
+    {
+        body_tree.prefetch_leaves(last, last + chunk_size);
+        body_tree.compute_accels(bodies, accels, first, last, scheduler.get());
+
+        scheduler -> parallel_for(first, last, grain, [this, dt, first](size_t block_begin, size_t block_end)
+        {
+            for(size_t i = block_begin; i < block_end; ++i)
+            {
+                bodies[i] -> kick(accels[i - first], dt);
+            }
+        });
+
+        body_tree.retire_leaves(first, last);
+    });
+
+    if(++steps_since_resort >= resort_interval)
+    {
+        resort(body_tree);
+        steps_since_resort = 0;
+    }
+}
+
+/**
+ * @brief Rewrites the body store in the order of a tree's leaves, bodies outside the tree last. The new store is
+ *        written sequentially, and since bodies move little between reorderings it is also read nearly sequentially.
+ *
+ * @param body_tree A tree built from the current bodies.
+*/
+void simulation::engine::resort(const b_h_tree& body_tree)
+{
+    store_type sorted(store_allocator());
+    sorted.reserve(body_store.size());
+
+    std::vector<bool> in_tree(body_store.size(), false);
+
+    for(body* ptr : body_tree.get_sorted_bodies())
+    {
+        sorted.push_back(*ptr);
+        in_tree[static_cast<size_t>(ptr - body_store.data())] = true;
+    }
+
+    for(size_t i = 0; i < body_store.size(); ++i)
+    {
+        if(!in_tree[i])
+        {
+            sorted.push_back(body_store[i]);
+        }
+    }
+
+    body_store = std::move(sorted);
+
+    refresh_bodies();
+}
+
+/**
+ * @brief Collision stage run after every step. Overlapping pairs are found through the spatial hash grid and are
+ *        either bounced elastically or merged. Merged bodies are removed and the body store is compacted, so the
+ *        cost of later steps drops as bodies merge.
+*/
+void simulation::engine::resolve_collisions()
+{
+    if(collisions == collision_mode::none || bodies.size() < 2)
+    {
+        return;
+    }
+
+    grid.rebuild(bodies);
+
+    std::vector<std::pair<size_t, size_t>> pairs = grid.find_overlaps(bodies);
+
+    if(pairs.empty())
+    {
+        return;
+    }
+
+    if(collisions == collision_mode::elastic)
+    {
+        for(const std::pair<size_t, size_t>& pair : pairs)
+        {
+            bodies[pair.first] -> bounce(bodies[pair.second]);
+        }
+        return;
+    }
+
+    std::vector<size_t> targets = merge_targets(pairs, bodies.size());
+
+    for(size_t i = 0; i < bodies.size(); ++i)
+    {
+        if(targets[i] != i)
+        {
+            bodies[targets[i]] -> absorb(bodies[i]);
+        }
+    }
+
+    size_t kept = 0;
+    for(size_t i = 0; i < body_store.size(); ++i)
+    {
+        if(targets[i] == i)
+        {
+            if(kept != i)
+            {
+                body_store[kept] = body_store[i];
+            }
+            ++kept;
+        }
+    }
+
+    body_store.erase(body_store.begin() + kept, body_store.end());
+
+    refresh_bodies();
+}
+
+/**
+ * @brief Rebuilds the vector of body pointers handed to the solvers after the body store has changed. With pinned
+ *        workers, the pages of the pointers and of the accelerations (in memory runs) are given back and refilled
+ *        under the static split of the steps, so they sit with the bodies they belong to.
+*/
+void simulation::engine::refresh_bodies()
+{
+    size_t count = body_store.size();
+
+    bodies.resize(count);
+
+    if(!scheduler -> is_pinned())
+    {
+        scheduler -> parallel_for(0, count, 4096, [this](size_t block_begin, size_t block_end)
+        {
+            for(size_t i = block_begin; i < block_end; ++i)
+            {
+                bodies[i] = &body_store[i];
+            }
+        });
+        return;
+    }
+
+    bool place_accels = !spill_directory;
+
+    discard_pages(bodies.data(), bodies.data() + count);
+
+    if(place_accels)
+    {
+        accels.resize(count);
+        discard_pages(accels.data(), accels.data() + count);
+    }
+
+    scheduler -> parallel_for_static(0, count, [this, place_accels](size_t block_begin, size_t block_end)
+    {
+        for(size_t i = block_begin; i < block_end; ++i)
+        {
+            bodies[i] = &body_store[i];
+
+            if(place_accels)
+            {
+                accels[i] = sf::Vector2<double>(0, 0);
+            }
+        }
+    });
+}
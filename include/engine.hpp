@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+#include <SFML/System/Vector2.hpp>
+#include <body.hpp>
+#include <collision.hpp>
+#include <particle_mesh.hpp>
+#include <task_scheduler.hpp>
+#include <solver.hpp>
+#include <autotuner.hpp>
+#include <strided_view.hpp>
+#include <placement.hpp>
+#include <interaction_cache.hpp>
+#include <diagnostics.hpp>
+
+namespace simulation
+{
+    /**
+     * @brief The engine class is the windowless core of a simulation, meant to be driven in-process by a host
+     *        application. It owns the bodies and the solvers, advances the system with step(), and exposes the
+     *        state as read-only views over the body store, so reading positions, velocities or accelerations never
+     *        copies them. Views are invalidated by adding bodies, by steps that merge bodies and by configurations
+     *        that change the thread count or pinning.
+     *        Conservation can be monitored with set_diagnostics(), which measures the energies and momenta every few
+     *        steps.
+     *        In out-of-core mode the body store and the tree's arrays (nodes, leaf data and leaf order) live in files,
+     *        and each step streams through them in chunks kept in the tree's spatial order, with one chunk of
+     *        accelerations in memory. What stays in memory is the vector of body pointers handed to get_bodies(), 8
+     *        bytes per body against roughly 100 spilled, which bounds how far a run can outgrow memory. The mode needs
+     *        Barnes Hut without collisions or autotuning, the parts that cannot stream, and diagnostics build their
+     *        tree in the spill files too.
+    */
+    class engine
+    {
+        private:
+            using store_type = std::vector<body, placed_allocator<body>>;
+
+            store_type body_store;
+            std::vector<body*> bodies;
+            std::vector<sf::Vector2<double>> accels;
+            solver_config config;
+            collision_mode collisions{collision_mode::elastic};
+            collision_grid grid;
+            particle_mesh mesh;
+            interaction_cache lists;
+            std::unique_ptr<task_scheduler> scheduler;
+            std::unique_ptr<autotuner> tuner;
+            std::unique_ptr<diagnostics> monitor;
+            double sim_time{};
+            size_t steps_taken{};
+            std::shared_ptr<const std::string> spill_directory;
+            size_t chunk_size{};
+            size_t resort_interval{};
+            size_t steps_since_resort{};
+
+            void refresh_bodies();
+
+            void resolve_collisions();
+
+            void apply_thread_count();
+
+            void retune();
+
+            void place_store();
+
+            placed_allocator<body> store_allocator() const;
+
+            template <typename F>
+            void stream(const F& func);
+
+            void step_out_of_core(double dt);
+
+            void resort(const b_h_tree& body_tree);
+
+        public:
+
+            engine(const solver_config& _config = solver_config{});
+
+            engine(size_t count, const double* masses, const double* positions, const double* velocities, const int* radii = nullptr, const solver_config& _config = solver_config{});
+
+            void add_body(double mass, int radius, bool inplace, sf::Vector2<double> position, sf::Vector2<double> velocity = sf::Vector2<double>(0, 0));
+
+            void add_bodies(std::vector<body> new_bodies);
+
+            void reserve(size_t count);
+
+            void step(double dt, size_t num_steps = 1);
+
+            void set_config(const solver_config& _config);
+
+            const solver_config& get_config() const;
+
+            void set_collision_mode(collision_mode mode);
+
+            void set_particle_mesh(size_t mesh_size, mass_assignment scheme, bool p3m);
+
+            void set_autotune(double tolerance, size_t retune_interval = 500, std::ostream* log = nullptr);
+
+            void set_out_of_core(const std::string& directory, size_t chunk_bodies = 1 << 18, size_t _resort_interval = 16);
+
+            void set_diagnostics(size_t interval, const std::string& path = "");
+
+            conserved_quantities measure();
+
+            size_t size() const;
+
+            double get_time() const;
+
+            size_t get_steps() const;
+
+            const std::vector<body*>& get_bodies() const;
+
+            strided_view<double> masses() const;
+
+            strided_view<sf::Vector2<double>> positions() const;
+
+            strided_view<sf::Vector2<double>> velocities() const;
+
+            strided_view<sf::Vector2<double>> accelerations() const;
+    };
+}
@@ -0,0 +1,319 @@
+#include <force_kernels.hpp>
+#include <settings.hpp>
+#include <body.hpp>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GRAVITYSIM_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    /**
+     * @brief Adds the sources [first, count) to ax and ay one at a time. Used as the portable variant and for the
+     *        tails left over by the vector variants.
+    */
+    void accumulate_tail(double x, double y, double radius, const double* xs, const double* ys, const double* masses, const double* radii, size_t first, size_t count, double& ax, double& ay)
+    {
+        for(size_t j = first; j < count; ++j)
+        {
+            sf::Vector2<double> accel = gravity_kernel(xs[j] - x, ys[j] - y, radii ? radius + radii[j] : radius, masses[j]);
+
+            ax += accel.x;
+            ay += accel.y;
+        }
+    }
+
+    void accumulate_scalar(double x, double y, double radius, const double* xs, const double* ys, const double* masses, const double* radii, size_t count, double& ax, double& ay)
+    {
+        accumulate_tail(x, y, radius, xs, ys, masses, radii, 0, count, ax, ay);
+    }
+
+#ifdef GRAVITYSIM_X86_KERNELS
+    /**
+     * @brief SSE2 variant, two sources per iteration. The vector variants follow gravity_kernel() lane by lane: the
+     *        distance is clamped to the reach, and coincident sources exert no force.
+    */
+    __attribute__((target("sse2")))
+    void accumulate_sse2(double x, double y, double radius, const double* xs, const double* ys, const double* masses, const double* radii, size_t count, double& ax, double& ay)
+    {
+        const __m128d px = _mm_set1_pd(x);
+        const __m128d py = _mm_set1_pd(y);
+        const __m128d base_reach = _mm_set1_pd(radius);
+        const __m128d g = _mm_set1_pd(settings::G);
+        const __m128d zero = _mm_setzero_pd();
+        const __m128d one = _mm_set1_pd(1);
+
+        __m128d sum_x = zero;
+        __m128d sum_y = zero;
+
+        size_t j = 0;
+        for(; j + 2 <= count; j += 2)
+        {
+            __m128d dx = _mm_sub_pd(_mm_loadu_pd(xs + j), px);
+            __m128d dy = _mm_sub_pd(_mm_loadu_pd(ys + j), py);
+            __m128d reach = radii ? _mm_add_pd(base_reach, _mm_loadu_pd(radii + j)) : base_reach;
+            __m128d gm = _mm_mul_pd(g, _mm_loadu_pd(masses + j));
+
+            __m128d dist_sq = _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy));
+            __m128d dist = _mm_sqrt_pd(dist_sq);
+            __m128d clamped = _mm_max_pd(dist, reach);
+
+            __m128d coincident = _mm_cmpeq_pd(dist_sq, zero);
+            __m128d apart = _mm_cmpneq_pd(dist_sq, zero);
+
+            __m128d denom = _mm_or_pd(_mm_and_pd(apart, _mm_mul_pd(_mm_mul_pd(clamped, clamped), dist)), _mm_and_pd(coincident, one));
+            __m128d scale = _mm_and_pd(apart, _mm_div_pd(gm, denom));
+
+            sum_x = _mm_add_pd(sum_x, _mm_mul_pd(dx, scale));
+            sum_y = _mm_add_pd(sum_y, _mm_mul_pd(dy, scale));
+        }
+
+        double lanes_x[2];
+        double lanes_y[2];
+        _mm_storeu_pd(lanes_x, sum_x);
+        _mm_storeu_pd(lanes_y, sum_y);
+
+        ax += lanes_x[0] + lanes_x[1];
+        ay += lanes_y[0] + lanes_y[1];
+
+        accumulate_tail(x, y, radius, xs, ys, masses, radii, j, count, ax, ay);
+    }
+
+    /**
+     * @brief AVX2 variant, four sources per iteration.
+    */
+    __attribute__((target("avx2,fma")))
+    void accumulate_avx2(double x, double y, double radius, const double* xs, const double* ys, const double* masses, const double* radii, size_t count, double& ax, double& ay)
+    {
+        const __m256d px = _mm256_set1_pd(x);
+        const __m256d py = _mm256_set1_pd(y);
+        const __m256d base_reach = _mm256_set1_pd(radius);
+        const __m256d g = _mm256_set1_pd(settings::G);
+        const __m256d zero = _mm256_setzero_pd();
+        const __m256d one = _mm256_set1_pd(1);
+
+        __m256d sum_x = zero;
+        __m256d sum_y = zero;
+
+        size_t j = 0;
+        for(; j + 4 <= count; j += 4)
+        {
+            __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(xs + j), px);
+            __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(ys + j), py);
+            __m256d reach = radii ? _mm256_add_pd(base_reach, _mm256_loadu_pd(radii + j)) : base_reach;
+            __m256d gm = _mm256_mul_pd(g, _mm256_loadu_pd(masses + j));
+
+            __m256d dist_sq = _mm256_fmadd_pd(dx, dx, _mm256_mul_pd(dy, dy));
+            __m256d dist = _mm256_sqrt_pd(dist_sq);
+            __m256d clamped = _mm256_max_pd(dist, reach);
+
+            __m256d coincident = _mm256_cmp_pd(dist_sq, zero, _CMP_EQ_OQ);
+
+            __m256d denom = _mm256_blendv_pd(_mm256_mul_pd(_mm256_mul_pd(clamped, clamped), dist), one, coincident);
+            __m256d scale = _mm256_blendv_pd(_mm256_div_pd(gm, denom), zero, coincident);
+
+            sum_x = _mm256_fmadd_pd(dx, scale, sum_x);
+            sum_y = _mm256_fmadd_pd(dy, scale, sum_y);
+        }
+
+        double lanes_x[4];
+        double lanes_y[4];
+        _mm256_storeu_pd(lanes_x, sum_x);
+        _mm256_storeu_pd(lanes_y, sum_y);
+
+        ax += (lanes_x[0] + lanes_x[1]) + (lanes_x[2] + lanes_x[3]);
+        ay += (lanes_y[0] + lanes_y[1]) + (lanes_y[2] + lanes_y[3]);
+
+        accumulate_tail(x, y, radius, xs, ys, masses, radii, j, count, ax, ay);
+    }
+
+    /**
+     * @brief Adds the eight lanes of an AVX-512 vector. Written with masked extracts of an explicit zero source
+     *        because the unmasked intrinsics pass an undefined vector that GCC 12 reports as uninitialized.
+    */
+    __attribute__((target("avx512f")))
+    double reduce_add_avx512(__m512d v)
+    {
+        const __mmask8 all = 0xFF;
+
+        __m256d low = _mm512_mask_extractf64x4_pd(_mm256_setzero_pd(), all, v, 0);
+        __m256d high = _mm512_mask_extractf64x4_pd(_mm256_setzero_pd(), all, v, 1);
+        __m256d quad = _mm256_add_pd(low, high);
+        __m128d pair = _mm_add_pd(_mm256_castpd256_pd128(quad), _mm256_extractf128_pd(quad, 1));
+
+        return _mm_cvtsd_f64(_mm_add_sd(pair, _mm_unpackhi_pd(pair, pair)));
+    }
+
+    /**
+     * @brief AVX-512 variant, eight sources per iteration.
+    */
+    __attribute__((target("avx512f")))
+    void accumulate_avx512(double x, double y, double radius, const double* xs, const double* ys, const double* masses, const double* radii, size_t count, double& ax, double& ay)
+    {
+        const __m512d px = _mm512_set1_pd(x);
+        const __m512d py = _mm512_set1_pd(y);
+        const __m512d base_reach = _mm512_set1_pd(radius);
+        const __m512d g = _mm512_set1_pd(settings::G);
+        const __m512d zero = _mm512_setzero_pd();
+        const __m512d one = _mm512_set1_pd(1);
+        const __mmask8 all = 0xFF;
+
+        __m512d sum_x = zero;
+        __m512d sum_y = zero;
+
+        size_t j = 0;
+        for(; j + 8 <= count; j += 8)
+        {
+            __m512d dx = _mm512_sub_pd(_mm512_loadu_pd(xs + j), px);
+            __m512d dy = _mm512_sub_pd(_mm512_loadu_pd(ys + j), py);
+            __m512d reach = radii ? _mm512_add_pd(base_reach, _mm512_loadu_pd(radii + j)) : base_reach;
+            __m512d gm = _mm512_mul_pd(g, _mm512_loadu_pd(masses + j));
+
+            __m512d dist_sq = _mm512_fmadd_pd(dx, dx, _mm512_mul_pd(dy, dy));
+            __m512d dist = _mm512_mask_sqrt_pd(zero, all, dist_sq);
+            __m512d clamped = _mm512_mask_max_pd(zero, all, dist, reach);
+
+            __mmask8 coincident = _mm512_cmp_pd_mask(dist_sq, zero, _CMP_EQ_OQ);
+
+            __m512d denom = _mm512_mask_blend_pd(coincident, _mm512_mul_pd(_mm512_mul_pd(clamped, clamped), dist), one);
+            __m512d scale = _mm512_maskz_div_pd(static_cast<__mmask8>(~coincident), gm, denom);
+
+            sum_x = _mm512_fmadd_pd(dx, scale, sum_x);
+            sum_y = _mm512_fmadd_pd(dy, scale, sum_y);
+        }
+
+        ax += reduce_add_avx512(sum_x);
+        ay += reduce_add_avx512(sum_y);
+
+        accumulate_tail(x, y, radius, xs, ys, masses, radii, j, count, ax, ay);
+    }
+#endif
+
+    const simulation::kernel_variant SCALAR{"scalar", accumulate_scalar};
+
+#ifdef GRAVITYSIM_X86_KERNELS
+    const simulation::kernel_variant SSE2{"sse2", accumulate_sse2};
+
+    const simulation::kernel_variant AVX2{"avx2", accumulate_avx2};
+
+    const simulation::kernel_variant AVX512{"avx512", accumulate_avx512};
+#endif
+
+    /**
+     * @brief Gets the variant with the given name if the CPU can run it, or nullptr.
+    */
+    const simulation::kernel_variant* supported_variant(const std::string& name)
+    {
+        if(name == SCALAR.name)
+        {
+            return &SCALAR;
+        }
+
+#ifdef GRAVITYSIM_X86_KERNELS
+        __builtin_cpu_init();
+
+        if(name == SSE2.name && __builtin_cpu_supports("sse2"))
+        {
+            return &SSE2;
+        }
+
+        if(name == AVX2.name && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        {
+            return &AVX2;
+        }
+
+        if(name == AVX512.name && __builtin_cpu_supports("avx512f"))
+        {
+            return &AVX512;
+        }
+#endif
+
+        return nullptr;
+    }
+
+    /**
+     * @brief Picks the startup variant: the one named by the GRAVITYSIM_KERNEL environment variable if the CPU
+     *        supports it, otherwise the widest supported one.
+    */
+    const simulation::kernel_variant* startup_variant()
+    {
+        const char* forced = std::getenv("GRAVITYSIM_KERNEL");
+
+        if(forced != nullptr)
+        {
+            if(const simulation::kernel_variant* variant = supported_variant(forced))
+            {
+                return variant;
+            }
+        }
+
+        for(const char* name : {"avx512", "avx2", "sse2"})
+        {
+            if(const simulation::kernel_variant* variant = supported_variant(name))
+            {
+                return variant;
+            }
+        }
+
+        return &SCALAR;
+    }
+
+    std::atomic<const simulation::kernel_variant*>& current_variant()
+    {
+        static std::atomic<const simulation::kernel_variant*> variant{startup_variant()};
+
+        return variant;
+    }
+}
+
+/**
+ * @brief Gets the force kernels in use. They are chosen on first use from the CPU's features, or from the
+ *        GRAVITYSIM_KERNEL environment variable (scalar, sse2, avx2 or avx512) when it names a supported variant.
+ *
+ * @return const kernel_variant& The variant in use.
+*/
+const simulation::kernel_variant& simulation::active_kernels()
+{
+    return *current_variant().load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Forces a variant of the force kernels, for benchmarking or comparing results.
+ *
+ * @param name Name of the variant: scalar, sse2, avx2 or avx512.
+ * @return bool False, leaving the variant unchanged, if the name is unknown or the CPU cannot run it.
+*/
+bool simulation::select_kernels(const std::string& name)
+{
+    const kernel_variant* variant = supported_variant(name);
+
+    if(variant == nullptr)
+    {
+        return false;
+    }
+
+    current_variant().store(variant, std::memory_order_relaxed);
+    return true;
+}
+
+/**
+ * @brief Gets the names of the variants this CPU can run, separated by spaces.
+*/
+std::string simulation::available_kernels()
+{
+    std::string names;
+
+    for(const char* name : {"scalar", "sse2", "avx2", "avx512"})
+    {
+        if(supported_variant(name) != nullptr)
+        {
+            names += names.empty() ? name : std::string{" "} + name;
+        }
+    }
+
+    return names;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace simulation
+{
+    /**
+     * @brief Sums the accelerations induced on a body at (x, y) with the given radius by count point masses stored as
+     *        arrays, applying gravity_kernel() to every source with a reach of radius + radii[j] (just radius when
+     *        radii is nullptr, as for cells). The sums are added to ax and ay.
+    */
+    using accumulate_kernel = void (*)(double x, double y, double radius, const double* xs, const double* ys, const double* masses, const double* radii, size_t count, double& ax, double& ay);
+
+    /**
+     * @brief One compiled variant of the force kernels and the instruction set it targets.
+    */
+    struct kernel_variant
+    {
+        const char* name;
+
+        accumulate_kernel accumulate;
+    };
+
+    const kernel_variant& active_kernels();
+
+    bool select_kernels(const std::string& name);
+
+    std::string available_kernels();
+}
@@ -0,0 +1,438 @@
+#include <initial_conditions.hpp>
+#include <counter_rng.hpp>
+#include <parallel.hpp>
+#include <settings.hpp>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace
+{
+    const char BINARY_MAGIC[8] = {'G', 'S', 'I', 'M', 'B', 'I', 'N', '\0'};
+
+    /**
+     * @brief Header of the binary initial condition format, followed by num_bodies packed_body records.
+    */
+    struct binary_header
+    {
+        char magic[8];
+
+        std::uint64_t num_bodies;
+    };
+
+    /**
+     * @brief Read-only memory mapping of a whole file, unmapped when it goes out of scope.
+    */
+    class mapped_file
+    {
+        public:
+            const char* data{};
+            size_t size{};
+
+            mapped_file(const std::string& path)
+            {
+                int fd = open(path.c_str(), O_RDONLY);
+                if(fd < 0)
+                {
+                    throw std::runtime_error("could not open initial condition file " + path);
+                }
+
+                struct stat file_stat{};
+                if(fstat(fd, &file_stat) != 0)
+                {
+                    close(fd);
+                    throw std::runtime_error("could not read the size of initial condition file " + path);
+                }
+                size = static_cast<size_t>(file_stat.st_size);
+
+                if(size > 0)
+                {
+                    void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                    if(addr == MAP_FAILED)
+                    {
+                        close(fd);
+                        throw std::runtime_error("could not map initial condition file " + path);
+                    }
+                    data = static_cast<const char*>(addr);
+                    madvise(addr, size, MADV_SEQUENTIAL);
+                }
+
+                close(fd);
+            }
+
+            ~mapped_file()
+            {
+                if(data != nullptr)
+                {
+                    munmap(const_cast<char*>(data), size);
+                }
+            }
+
+            mapped_file(const mapped_file&) = delete;
+
+            mapped_file& operator=(const mapped_file&) = delete;
+    };
+
+    /**
+     * @brief Placeholder used to size the body store before it is filled in parallel.
+    */
+    body empty_body()
+    {
+        return body{0, 0, true, sf::Vector2<double>(0, 0)};
+    }
+
+    /**
+     * @brief Determines whether a CSV line holds a body record. Blank lines, comments (#) and a header row are skipped.
+    */
+    bool is_record(const char* line, const char* line_end)
+    {
+        while(line < line_end && (*line == ' ' || *line == '\t'))
+        {
+            ++line;
+        }
+
+        return line < line_end && (std::isdigit(static_cast<unsigned char>(*line)) || *line == '-' || *line == '+' || *line == '.');
+    }
+
+    /**
+     * @brief Parses a CSV record of the form mass,radius,inplace,x,y[,vx,vy]. Throws if the five leading fields are
+     *        not all there.
+    */
+    body parse_record(const char* line, const char* line_end)
+    {
+        const size_t required_fields = 5;
+
+        char buffer[512];
+        size_t length = std::min<size_t>(line_end - line, sizeof(buffer) - 1);
+        std::memcpy(buffer, line, length);
+        buffer[length] = '\0';
+
+        double fields[7]{};
+        size_t num_fields = 0;
+        char* cursor = buffer;
+
+        for(double& field : fields)
+        {
+            char* next = nullptr;
+            field = std::strtod(cursor, &next);
+            if(next == cursor)
+            {
+                break;
+            }
+            ++num_fields;
+            cursor = next;
+            while(*cursor == ',' || *cursor == ' ' || *cursor == '\t')
+            {
+                ++cursor;
+            }
+        }
+
+        if(num_fields < required_fields)
+        {
+            throw std::runtime_error("malformed initial condition record: " + std::string(buffer));
+        }
+
+        return body{fields[0], static_cast<int>(fields[1]), fields[2] != 0,
+                    sf::Vector2<double>(fields[3], fields[4]), sf::Vector2<double>(fields[5], fields[6])};
+    }
+
+    /**
+     * @brief Moves a chunk boundary forward to the start of the next line.
+    */
+    size_t align_to_line(const char* data, size_t size, size_t offset)
+    {
+        if(offset == 0 || offset >= size)
+        {
+            return std::min(offset, size);
+        }
+
+        const void* newline = std::memchr(data + offset - 1, '\n', size - offset + 1);
+
+        return newline == nullptr ? size : static_cast<const char*>(newline) - data + 1;
+    }
+
+    /**
+     * @brief Calls func(line_begin, line_end) for every record in [begin, end).
+    */
+    template <typename F>
+    void for_each_record(const char* begin, const char* end, F&& func)
+    {
+        while(begin < end)
+        {
+            const char* line_end = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+            if(line_end == nullptr)
+            {
+                line_end = end;
+            }
+
+            if(is_record(begin, line_end))
+            {
+                func(begin, line_end);
+            }
+
+            begin = line_end + 1;
+        }
+    }
+
+    /**
+     * @brief Samples a point uniformly distributed on the unit sphere and returns its x and y components.
+    */
+    sf::Vector2<double> isotropic_direction(simulation::counter_rng& rng)
+    {
+        double cos_theta = rng.uniform(-1, 1);
+        double sin_theta = std::sqrt(1 - cos_theta * cos_theta);
+        double phi = rng.uniform(0, 2 * M_PI);
+
+        return sf::Vector2<double>(sin_theta * std::cos(phi), sin_theta * std::sin(phi));
+    }
+
+    /**
+     * @brief Samples a body of a Plummer sphere (Aarseth, Henon & Wielen 1974) projected onto the plane. Samples
+     *        beyond max_radius are drawn again: the tree's root is the window, so a body outside it would be left out
+     *        of the tree and clamped to the window's edge on its first kick.
+    */
+    body plummer_body(simulation::counter_rng& rng, double mass, double total_mass, double scale, double max_radius, sf::Vector2<double> center)
+    {
+        double r{};
+        do
+        {
+            r = scale / std::sqrt(std::pow(rng.uniform(), -2.0 / 3.0) - 1);
+        }
+        while(r > max_radius);
+
+        double q{};
+        double g{};
+        do
+        {
+            q = rng.uniform();
+            g = rng.uniform(0, 0.1);
+        }
+        while(g > q * q * std::pow(1 - q * q, 3.5));
+
+        double escape_speed = std::sqrt(2 * settings::G * total_mass / std::sqrt(r * r + scale * scale));
+
+        sf::Vector2<double> position = center + isotropic_direction(rng) * r;
+        sf::Vector2<double> velocity = isotropic_direction(rng) * (q * escape_speed);
+
+        return body{mass, 1, false, position, velocity};
+    }
+
+    /**
+     * @brief Samples a body of a rotationally supported disk with an exponential surface density profile. Samples
+     *        beyond max_radius are drawn again, for the same reason as in plummer_body().
+    */
+    body exponential_disk_body(simulation::counter_rng& rng, double mass, double total_mass, double scale, double max_radius, sf::Vector2<double> center)
+    {
+        double r{};
+        do
+        {
+            r = -scale * std::log(rng.uniform() * rng.uniform());
+        }
+        while(r > max_radius);
+
+        double phi = rng.uniform(0, 2 * M_PI);
+
+        double x = r / scale;
+        double enclosed_mass = total_mass * (1 - (1 + x) * std::exp(-x));
+        double speed = std::sqrt(settings::G * enclosed_mass / r);
+
+        sf::Vector2<double> position = center + sf::Vector2<double>(std::cos(phi), std::sin(phi)) * r;
+        sf::Vector2<double> velocity = sf::Vector2<double>(-std::sin(phi), std::cos(phi)) * speed;
+
+        return body{mass, 1, false, position, velocity};
+    }
+
+    /**
+     * @brief Samples a body at rest, uniformly distributed over a disk.
+    */
+    body cold_collapse_body(simulation::counter_rng& rng, double mass, double scale, sf::Vector2<double> center)
+    {
+        double r = scale * std::sqrt(rng.uniform());
+        double phi = rng.uniform(0, 2 * M_PI);
+
+        sf::Vector2<double> position = center + sf::Vector2<double>(std::cos(phi), std::sin(phi)) * r;
+
+        return body{mass, 1, false, position};
+    }
+}
+
+/**
+ * @brief Flattens a body into a packed_body record.
+ *
+ * @param b The body to pack.
+ * @return packed_body The record holding the state of the body.
+*/
+simulation::packed_body simulation::pack(body* b)
+{
+    sf::Vector2<double> position = b -> get_position();
+    sf::Vector2<double> velocity = b -> get_velocity();
+
+    return packed_body{b -> get_mass(), static_cast<double>(b -> get_radius()), b -> is_inplace() ? 1.0 : 0.0,
+                       position.x, position.y, velocity.x, velocity.y};
+}
+
+/**
+ * @brief Rebuilds a body from a packed_body record.
+ *
+ * @param record The record to unpack.
+ * @return body The body described by the record.
+*/
+body simulation::unpack(const packed_body& record)
+{
+    return body{record.mass, static_cast<int>(record.radius), record.inplace != 0,
+                sf::Vector2<double>(record.position_x, record.position_y),
+                sf::Vector2<double>(record.velocity_x, record.velocity_y)};
+}
+
+/**
+ * @brief Appends the bodies of a CSV file to the body store. Each record is mass,radius,inplace,x,y[,vx,vy].
+ *        The file is memory mapped, records are counted and parsed in parallel, and the store grows with a single
+ *        allocation.
+ *
+ * @param path Path of the CSV file.
+ * @param store The body store that the bodies are appended to.
+*/
+void simulation::load_csv(const std::string& path, std::vector<body>& store)
+{
+    mapped_file file{path};
+
+    size_t workers = worker_count();
+
+    std::vector<size_t> chunk_bounds(workers + 1);
+    for(size_t w = 0; w <= workers; ++w)
+    {
+        chunk_bounds[w] = align_to_line(file.data, file.size, file.size * w / workers);
+    }
+
+    std::vector<size_t> chunk_offsets(workers + 1);
+
+    parallel_for(0, workers, [&](size_t w)
+    {
+        size_t count = 0;
+        for_each_record(file.data + chunk_bounds[w], file.data + chunk_bounds[w + 1], [&count](const char*, const char*) { ++count; });
+        chunk_offsets[w + 1] = count;
+    }, 1);
+
+    for(size_t w = 0; w < workers; ++w)
+    {
+        chunk_offsets[w + 1] += chunk_offsets[w];
+    }
+
+    size_t base = store.size();
+    store.resize(base + chunk_offsets[workers], empty_body());
+
+    parallel_for(0, workers, [&](size_t w)
+    {
+        size_t index = base + chunk_offsets[w];
+        for_each_record(file.data + chunk_bounds[w], file.data + chunk_bounds[w + 1], [&](const char* line, const char* line_end)
+        {
+            store[index++] = parse_record(line, line_end);
+        });
+    }, 1);
+}
+
+/**
+ * @brief Appends the bodies of a binary initial condition file written by save_binary() to the body store.
+ *
+ * @param path Path of the binary file.
+ * @param store The body store that the bodies are appended to.
+*/
+void simulation::load_binary(const std::string& path, std::vector<body>& store)
+{
+    mapped_file file{path};
+
+    const binary_header* header = reinterpret_cast<const binary_header*>(file.data);
+
+    if(file.size < sizeof(binary_header) || std::memcmp(header -> magic, BINARY_MAGIC, sizeof(BINARY_MAGIC)) != 0
+        || sizeof(binary_header) + header -> num_bodies * sizeof(packed_body) > file.size)
+    {
+        throw std::runtime_error(path + " is not a valid binary initial condition file");
+    }
+
+    const packed_body* records = reinterpret_cast<const packed_body*>(file.data + sizeof(binary_header));
+
+    size_t base = store.size();
+    store.resize(base + header -> num_bodies, empty_body());
+
+    parallel_for(0, header -> num_bodies, [&](size_t i)
+    {
+        store[base + i] = unpack(records[i]);
+    });
+}
+
+/**
+ * @brief Writes bodies to the binary initial condition format read by load_binary().
+ *
+ * @param path Path of the binary file, it is truncated if it already exists.
+ * @param bodies The bodies to write.
+*/
+void simulation::save_binary(const std::string& path, const std::vector<body*>& bodies)
+{
+    std::ofstream out{path, std::ios::binary | std::ios::trunc};
+    if(!out)
+    {
+        throw std::runtime_error("could not open initial condition file " + path);
+    }
+
+    binary_header header{};
+    std::memcpy(header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC));
+    header.num_bodies = bodies.size();
+
+    std::vector<packed_body> records(bodies.size());
+
+    parallel_for(0, bodies.size(), [&](size_t i)
+    {
+        records[i] = pack(bodies[i]);
+    });
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(packed_body));
+}
+
+/**
+ * @brief Appends bodies sampled from a standard distribution to the body store, centred in the window and
+ *        truncated so that every body starts inside it. Body i draws its random numbers from stream i of a
+ *        counter-based generator, so the result only depends on the seed and not on the number of threads.
+ *
+ * @param kind The distribution to sample.
+ * @param num_bodies Number of bodies to generate.
+ * @param total_mass Total mass shared equally between the generated bodies.
+ * @param seed Seed of the run.
+ * @param store The body store that the bodies are appended to.
+*/
+void simulation::generate(distribution kind, size_t num_bodies, double total_mass, std::uint64_t seed, std::vector<body>& store)
+{
+    sf::Vector2<double> center(settings::DIMENSIONS.first / 2.0, settings::DIMENSIONS.second / 2.0);
+    double extent = std::min(settings::DIMENSIONS.first, settings::DIMENSIONS.second);
+    double max_radius = extent / 2 - 1;
+    double mass = num_bodies > 0 ? total_mass / num_bodies : 0;
+
+    size_t base = store.size();
+    store.resize(base + num_bodies, empty_body());
+
+    parallel_for(0, num_bodies, [&](size_t i)
+    {
+        counter_rng rng{seed, i};
+
+        switch(kind)
+        {
+            case distribution::plummer:
+                store[base + i] = plummer_body(rng, mass, total_mass, extent / 16, max_radius, center);
+                break;
+            case distribution::exponential_disk:
+                store[base + i] = exponential_disk_body(rng, mass, total_mass, extent / 12, max_radius, center);
+                break;
+            case distribution::cold_collapse:
+                store[base + i] = cold_collapse_body(rng, mass, extent / 3, center);
+                break;
+        }
+    });
+}
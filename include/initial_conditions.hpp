@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <body.hpp>
+
+namespace simulation
+{
+    /**
+     * @brief Standard distributions that can be generated as initial conditions.
+    */
+    enum class distribution
+    {
+        plummer,
+        exponential_disk,
+        cold_collapse
+    };
+
+    /**
+     * @brief The state of a body as a flat record of doubles. Used by the binary initial condition format and
+     *        whenever bodies are shipped between processes.
+    */
+    struct packed_body
+    {
+        double mass;
+        double radius;
+        double inplace;
+        double position_x;
+        double position_y;
+        double velocity_x;
+        double velocity_y;
+    };
+
+    packed_body pack(body* b);
+
+    body unpack(const packed_body& record);
+
+    void load_csv(const std::string& path, std::vector<body>& store);
+
+    void load_binary(const std::string& path, std::vector<body>& store);
+
+    void save_binary(const std::string& path, const std::vector<body*>& bodies);
+
+    void generate(distribution kind, size_t num_bodies, double total_mass, std::uint64_t seed, std::vector<body>& store);
+}
@@ -0,0 +1,143 @@
+#include <interaction_cache.hpp>
+#include <settings.hpp>
+#include <task_scheduler.hpp>
+#include <unordered_map>
+
+/**
+ * @brief Determines whether the tree and its lists must be rebuilt before the next evaluation.
+ *
+ * @param bodies The bodies in the sim.
+ * @param _opening_angle Opening angle asked for.
+ * @param _leaf_size Leaf size asked for.
+ * @param _margin Margin asked for.
+ * @return bool True if the cached lists cannot be reused.
+*/
+bool simulation::interaction_cache::needs_rebuild(const std::vector<body*>& bodies, double _opening_angle, size_t _leaf_size, double _margin) const
+{
+    if(!tree || bodies != cached_bodies || _opening_angle != opening_angle || _leaf_size != leaf_size || _margin != margin || dimensions != settings::DIMENSIONS)
+    {
+        return true;
+    }
+
+    double limit = margin * margin / 4;
+
+    for(size_t i = 0; i < bodies.size(); ++i)
+    {
+        sf::Vector2<double> moved = bodies[i] -> get_position() - anchors[i];
+
+        if(moved.x * moved.x + moved.y * moved.y > limit)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Builds a new tree and its interaction lists, and records where every body stands.
+ *
+ * @param bodies The bodies in the sim.
+ * @param scheduler Scheduler running the build.
+*/
+void simulation::interaction_cache::rebuild(const std::vector<body*>& bodies, task_scheduler& scheduler)
+{
+    tree = std::make_unique<b_h_tree>(bodies, &scheduler, opening_angle, leaf_size);
+    tree -> build_interaction_lists(margin, &scheduler);
+
+    cached_bodies = bodies;
+    dimensions = settings::DIMENSIONS;
+
+    anchors.resize(bodies.size());
+    for(size_t i = 0; i < bodies.size(); ++i)
+    {
+        anchors[i] = bodies[i] -> get_position();
+    }
+
+    std::unordered_map<const body*, size_t> positions_in_input;
+    positions_in_input.reserve(bodies.size());
+    for(size_t i = 0; i < bodies.size(); ++i)
+    {
+        positions_in_input.emplace(bodies[i], i);
+    }
+
+    const b_h_tree::body_list& sorted_bodies = tree -> get_sorted_bodies();
+
+    std::vector<bool> in_tree(bodies.size(), false);
+
+    input_index.resize(sorted_bodies.size());
+    for(size_t i = 0; i < sorted_bodies.size(); ++i)
+    {
+        input_index[i] = positions_in_input[sorted_bodies[i]];
+        in_tree[input_index[i]] = true;
+    }
+
+    outside_tree.clear();
+    for(size_t i = 0; i < bodies.size(); ++i)
+    {
+        if(!in_tree[i])
+        {
+            outside_tree.push_back(i);
+        }
+    }
+
+    ++rebuilds;
+}
+
+/**
+ * @brief Computes the acceleration of every body, reusing the cached tree and lists when the bodies have not moved
+ *        beyond the margin since they were built. Bodies lying outside the tree's root quadrant walk the tree.
+ *
+ * @param bodies The bodies in the sim.
+ * @param accels Resized to bodies.size(), accels[i] receives the acceleration of bodies[i].
+ * @param scheduler Scheduler running the work.
+ * @param _opening_angle A cell is approximated by its center of mass once width / distance drops below this ratio.
+ * @param _leaf_size Largest number of bodies kept in a single leaf.
+ * @param _margin Distance by which bodies may approach accepted cells before the lists are rebuilt.
+*/
+void simulation::interaction_cache::compute(const std::vector<body*>& bodies, std::vector<sf::Vector2<double>>& accels, task_scheduler& scheduler, double _opening_angle, size_t _leaf_size, double _margin)
+{
+    if(needs_rebuild(bodies, _opening_angle, _leaf_size, _margin))
+    {
+        opening_angle = _opening_angle;
+        leaf_size = _leaf_size;
+        margin = _margin;
+
+        rebuild(bodies, scheduler);
+    }
+    else
+    {
+        tree -> refit(&scheduler);
+        ++reuses;
+    }
+
+    tree -> compute_accels_from_lists(sorted_accels, &scheduler);
+
+    accels.resize(bodies.size());
+
+    for(size_t i = 0; i < sorted_accels.size(); ++i)
+    {
+        accels[input_index[i]] = sorted_accels[i];
+    }
+
+    for(size_t i : outside_tree)
+    {
+        accels[i] = tree -> get_accel(bodies[i]);
+    }
+}
+
+/**
+ * @brief Gets the number of times the tree and lists were built.
+*/
+size_t simulation::interaction_cache::num_rebuilds() const
+{
+    return rebuilds;
+}
+
+/**
+ * @brief Gets the number of steps that reused the lists.
+*/
+size_t simulation::interaction_cache::num_reuses() const
+{
+    return reuses;
+}
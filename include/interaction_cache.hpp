@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <SFML/System/Vector2.hpp>
+#include <body.hpp>
+#include <barnes_hut_tree.hpp>
+
+namespace simulation
+{
+    class task_scheduler;
+
+    /**
+     * @brief The interaction_cache object keeps a Barnes Hut tree and its interaction lists across steps. While every
+     *        body stays within half the margin of where it was when the lists were built, a step only refits the
+     *        node moments and evaluates the lists; the tree is rebuilt and the lists regenerated once a body moves
+     *        further, the set of bodies changes, the tree parameters change, or the window resizes the tree's root.
+    */
+    class interaction_cache
+    {
+        private:
+            std::unique_ptr<b_h_tree> tree;
+            std::vector<body*> cached_bodies;
+            std::vector<sf::Vector2<double>> anchors;
+            std::vector<size_t> input_index;
+            std::vector<size_t> outside_tree;
+            std::vector<sf::Vector2<double>> sorted_accels;
+            double opening_angle{};
+            size_t leaf_size{};
+            double margin{};
+            std::pair<int, int> dimensions{};
+            size_t rebuilds{};
+            size_t reuses{};
+
+            bool needs_rebuild(const std::vector<body*>& bodies, double _opening_angle, size_t _leaf_size, double _margin) const;
+
+            void rebuild(const std::vector<body*>& bodies, task_scheduler& scheduler);
+
+        public:
+
+            void compute(const std::vector<body*>& bodies, std::vector<sf::Vector2<double>>& accels, task_scheduler& scheduler, double _opening_angle, size_t _leaf_size, double _margin);
+
+            size_t num_rebuilds() const;
+
+            size_t num_reuses() const;
+    };
+}
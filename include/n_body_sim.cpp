@@ -3,35 +3,35 @@
 #include <iostream>
 #include <barnes_hut_tree.hpp>
 #include <cmath>
+#include <algorithm>
 
 /**
  * @brief Constructs a n_body_sim object.
 */
-simulation::n_body_sim::n_body_sim() : bodies{}, window(sf::VideoMode(settings::DIMENSIONS.first, settings::DIMENSIONS.second), "N body sim")
+simulation::n_body_sim::n_body_sim() : sim_engine{}, window(sf::VideoMode(settings::DIMENSIONS.first, settings::DIMENSIONS.second), "N body sim")
 , Clock{}
 {
     
 }
 
 /**
- * @brief Destructor for the n_body_sim object, cleans up dynamically allocated memory.
+ * @brief Destructor for the n_body_sim object. The bodies live in the engine and are released with it.
 */
 simulation::n_body_sim::~n_body_sim()
 {
-    for(body* body_ptr : bodies)
-    {
-        delete body_ptr;
-    }
+
 }
 
 /**
  * @brief Initializes a n body sim with an inputted number of bodies. The bodies have random mass, random radius, and
  *        random initial positions and initial velocities.
  * @param num_bodies The number of bodies in the n body sim.
- * @param b_h_flag True if a simulation using the Barnes Hut method is desired, false if a naive simulation is desired.
+ * @param solver The engine used to compute the accelerations of the bodies.
 */
-void simulation::n_body_sim::random_sim_init(size_t num_bodies, bool b_h_flag)
+void simulation::n_body_sim::random_sim_init(size_t num_bodies, solver_type solver)
 {
+    sim_engine.reserve(sim_engine.size() + num_bodies);
+
     for(size_t i = 0; i < num_bodies; ++i)
     {
         add_body(rand() % 500 + 50, 
@@ -42,21 +42,14 @@ void simulation::n_body_sim::random_sim_init(size_t num_bodies, bool b_h_flag)
                     std::make_pair(rand() % 10 - 5, rand() % 10 - 5));
     }
 
-    if(b_h_flag)
-    {
-        init_barnes_hut();
-    }
-    else
-    {
-        init();
-    }
+    run(solver);
 }
 
 /**
  * @brief Initializes a n body sim with circular orbit.
- * @param b_h_flag True if a simulation using the Barnes Hut method is desired, false if a naive simulation is desired.
+ * @param solver The engine used to compute the accelerations of the bodies.
 */
-void simulation::n_body_sim::circular_orbit(bool b_h_flag)
+void simulation::n_body_sim::circular_orbit(solver_type solver)
 {
     double m1 = 50;
     double m2 = 100;
@@ -69,14 +62,65 @@ void simulation::n_body_sim::circular_orbit(bool b_h_flag)
     add_body(m1, r1, false, std::make_pair<double, double>(settings::DIMENSIONS.first / 2.0 + pos_diff, settings::DIMENSIONS.second / 2.0), std::make_pair<double, double>(0, -sqrt((m2 * settings::G) / pos_diff)));
     add_body(m2, r2, true, std::make_pair<double, double>(settings::DIMENSIONS.first / 2.0, settings::DIMENSIONS.second / 2.0), std::make_pair<double, double>(0, 0));
     
-    init();
+    run(solver);
 }
 
 /**
- * @brief Initializes a naive n body simulation.
+ * @brief Initializes a n body sim from an initial condition file. Files ending in .csv are read as CSV records of
+ *        mass,radius,inplace,x,y[,vx,vy], anything else as the binary format written by simulation::save_binary().
+ * @param path Path of the initial condition file.
+ * @param solver The engine used to compute the accelerations of the bodies.
 */
-void simulation::n_body_sim::init()
+void simulation::n_body_sim::file_init(const std::string& path, solver_type solver)
 {
+    const std::string csv_extension = ".csv";
+
+    std::vector<body> loaded;
+
+    if(path.size() >= csv_extension.size() && path.compare(path.size() - csv_extension.size(), csv_extension.size(), csv_extension) == 0)
+    {
+        load_csv(path, loaded);
+    }
+    else
+    {
+        load_binary(path, loaded);
+    }
+
+    sim_engine.add_bodies(std::move(loaded));
+
+    run(solver);
+}
+
+/**
+ * @brief Initializes a n body sim with bodies sampled from a standard distribution. The same seed always
+ *        produces the same initial conditions.
+ * @param kind The distribution to sample.
+ * @param num_bodies The number of bodies in the n body sim.
+ * @param total_mass The total mass of the bodies.
+ * @param seed Seed of the counter-based random number generator.
+ * @param solver The engine used to compute the accelerations of the bodies.
+*/
+void simulation::n_body_sim::distribution_init(distribution kind, size_t num_bodies, double total_mass, std::uint64_t seed, solver_type solver)
+{
+    std::vector<body> generated;
+
+    generate(kind, num_bodies, total_mass, seed, generated);
+
+    sim_engine.add_bodies(std::move(generated));
+
+    run(solver);
+}
+
+/**
+ * @brief Runs the simulation loop. Every frame advances the engine by the time since the last frame, then draws
+ *        and records the bodies. If set_autotune() was called, solver only serves until the first tuning.
+ * @param solver The engine used to compute the accelerations of the bodies.
+*/
+void simulation::n_body_sim::run(solver_type solver)
+{
+    solver_config config = sim_engine.get_config();
+    config.solver = solver;
+    sim_engine.set_config(config);
 
     while (window.isOpen())
     {
@@ -96,37 +140,129 @@ void simulation::n_body_sim::init()
         settings::DIMENSIONS.second = size.y;
 
         float Time = Clock.getElapsedTime().asSeconds();
-        
-        
+
         Clock.restart();
-        for(body* ptr : bodies)
-        {
-            ptr -> update_position(bodies, Time);
 
-            sf::CircleShape body_shape(ptr -> get_radius());
+        sim_engine.step(Time);
 
-            body_shape.setPosition(ptr -> get_position().x - ptr -> get_radius(), ptr -> get_position().y - ptr -> get_radius());
-            body_shape.setFillColor(sf::Color::Magenta);
-            window.draw(body_shape);
+        draw_bodies();
+
+        record_frame();
 
-        }
-        
-        
         std::cout << settings::DIMENSIONS.first << std::endl;
         std::cout << settings::DIMENSIONS.second << std::endl;
         std::cout << Time << std::endl;
         window.display();
+    }
+}
+
+/**
+ * @brief Draws every body in the sim to the window.
+*/
+void simulation::n_body_sim::draw_bodies()
+{
+    strided_view<sf::Vector2<double>> positions = sim_engine.positions();
+
+    for(size_t i = 0; i < positions.size(); ++i)
+    {
+        int radius = sim_engine.get_bodies()[i] -> get_radius();
+
+        sf::CircleShape body_shape(radius);
 
-        
+        body_shape.setPosition(positions[i].x - radius, positions[i].y - radius);
+        body_shape.setFillColor(sf::Color::Magenta);
+        window.draw(body_shape);
     }
 }
 
 /**
- * @brief Initializes a simulation using the Barnes Hut method of approximation.
+ * @brief Sets how overlapping bodies are resolved. Defaults to collision_mode::elastic.
+ * @param mode The collision mode used by the following steps.
+*/
+void simulation::n_body_sim::set_collision_mode(collision_mode mode)
+{
+    sim_engine.set_collision_mode(mode);
+}
+
+/**
+ * @brief Configures the particle mesh engine used by solver_type::particle_mesh.
+ * @param mesh_size Number of mesh cells along each side of the window, must be a power of two.
+ * @param scheme Mass assignment scheme (CIC or TSC).
+ * @param p3m True to add the direct-sum short-range correction.
 */
-void simulation::n_body_sim::init_barnes_hut()
+void simulation::n_body_sim::set_particle_mesh(size_t mesh_size, mass_assignment scheme, bool p3m)
 {
+    sim_engine.set_particle_mesh(mesh_size, scheme, p3m);
+}
 
+/**
+ * @brief Lets the autotuner pick the engine and its parameters for the following runs, reporting each choice on the
+ *        standard output.
+ * @param tolerance Largest relative RMS acceleration error accepted, compared with direct summation.
+ * @param retune_interval Number of steps between two tunings.
+*/
+void simulation::n_body_sim::set_autotune(double tolerance, size_t retune_interval)
+{
+    sim_engine.set_autotune(tolerance, retune_interval, &std::cout);
+}
+
+/**
+ * @brief Records every frame of the next simulation run to a trajectory file, which can later be
+ *        reviewed with playback() without recomputing the physics.
+ * @param path Path of the trajectory file to write.
+*/
+void simulation::n_body_sim::record(const std::string& path)
+{
+    recording_path = path;
+}
+
+/**
+ * @brief Appends the current state of the bodies to the trajectory file, if recording was requested.
+*/
+void simulation::n_body_sim::record_frame()
+{
+    if(recording_path.empty())
+    {
+        return;
+    }
+
+    if(!recorder)
+    {
+        recorder = std::make_unique<trajectory_writer>(recording_path, sim_engine.get_bodies());
+    }
+
+    recorder -> write_frame(sim_engine.get_time(), sim_engine.get_bodies());
+}
+
+/**
+ * @brief Plays back a recorded trajectory. The file is memory mapped and each frame is turned into one quad per
+ *        body from the mapped triplets and drawn in a single call, so no physics is recomputed.
+ *        Space pauses, Left/Right seek by a second, Up/Down double or halve the playback speed (a negative
+ *        speed plays backwards), Home/End jump to the start/end, and dragging with the left mouse button
+ *        scrubs through the recording.
+ * @param path Path of the trajectory file to play.
+*/
+void simulation::n_body_sim::playback(const std::string& path)
+{
+    trajectory_reader reader{path};
+
+    if(reader.num_frames() == 0)
+    {
+        return;
+    }
+
+    const size_t readahead = 8;
+
+    const double start_time = reader.frame(0).time;
+    const double end_time = reader.frame(reader.num_frames() - 1).time;
+
+    double playhead = start_time;
+    double speed = 1;
+    bool paused = false;
+
+    sf::VertexArray body_quads{sf::Quads};
+
+    Clock.restart();
 
     while (window.isOpen())
     {
@@ -137,40 +273,66 @@ void simulation::n_body_sim::init_barnes_hut()
             {
                 window.close();
             }
+            else if (event.type == sf::Event::KeyPressed)
+            {
+                switch (event.key.code)
+                {
+                    case sf::Keyboard::Space: paused = !paused; break;
+                    case sf::Keyboard::Right: playhead += 1; break;
+                    case sf::Keyboard::Left: playhead -= 1; break;
+                    case sf::Keyboard::Up: speed *= 2; break;
+                    case sf::Keyboard::Down: speed /= 2; break;
+                    case sf::Keyboard::R: speed = -speed; break;
+                    case sf::Keyboard::Home: playhead = start_time; break;
+                    case sf::Keyboard::End: playhead = end_time; break;
+                    default: break;
+                }
+            }
         }
         window.clear();
 
-        sf::Vector2u size = window.getSize();
-
-        settings::DIMENSIONS.first = size.x;
-        settings::DIMENSIONS.second = size.y;
-
         float Time = Clock.getElapsedTime().asSeconds();
-        
+
         Clock.restart();
 
+        if (sf::Mouse::isButtonPressed(sf::Mouse::Left))
+        {
+            double fraction = static_cast<double>(sf::Mouse::getPosition(window).x) / window.getSize().x;
+            playhead = start_time + fraction * (end_time - start_time);
+        }
+        else if (!paused)
+        {
+            playhead += Time * speed;
+        }
+
+        playhead = std::clamp(playhead, start_time, end_time);
 
-        
-        b_h_tree body_tree{bodies};
+        size_t index = reader.frame_at_time(playhead);
+        reader.prefetch(index, readahead, speed >= 0);
 
-        for(body* ptr : bodies)
+        trajectory_frame frame = reader.frame(index);
+
+        body_quads.resize(4 * frame.num_bodies);
+
+        for(size_t i = 0; i < frame.num_bodies; ++i)
         {
-            ptr -> update_position_barnes_hut(body_tree, Time);
+            const float* xyr = frame.bodies + 3 * i;
+            sf::Vertex* quad = &body_quads[4 * i];
 
-            sf::CircleShape body_shape(ptr -> get_radius());
+            quad[0].position = sf::Vector2f(xyr[0] - xyr[2], xyr[1] - xyr[2]);
+            quad[1].position = sf::Vector2f(xyr[0] + xyr[2], xyr[1] - xyr[2]);
+            quad[2].position = sf::Vector2f(xyr[0] + xyr[2], xyr[1] + xyr[2]);
+            quad[3].position = sf::Vector2f(xyr[0] - xyr[2], xyr[1] + xyr[2]);
 
-            body_shape.setPosition(ptr -> get_position().x - ptr -> get_radius(), ptr -> get_position().y - ptr -> get_radius());
-            body_shape.setFillColor(sf::Color::Magenta);
-            window.draw(body_shape);
+            for(size_t corner = 0; corner < 4; ++corner)
+            {
+                quad[corner].color = sf::Color::Magenta;
+            }
         }
-    
-        
-        std::cout << settings::DIMENSIONS.first << std::endl;
-        std::cout << settings::DIMENSIONS.second << std::endl;
-        std::cout << Time << std::endl;
-        window.display();
 
-        
+        window.draw(body_quads);
+
+        window.display();
     }
 }
 
@@ -187,8 +349,13 @@ void simulation::n_body_sim::add_body(double _mass, int _radius, bool _inplace,
     sf::Vector2<double> init_pos(position.first, position.second);
     sf::Vector2<double> init_vel(velocity.first, velocity.second);
 
-    body* new_body = new body{_mass, _radius, _inplace, init_pos, init_vel};
-
-    bodies.push_back(new_body);
+    sim_engine.add_body(_mass, _radius, _inplace, init_pos, init_vel);
+}
 
-}
\ No newline at end of file
+/**
+ * @brief Gets the engine stepping the bodies, for callers that want to inspect or configure it directly.
+*/
+simulation::engine& simulation::n_body_sim::get_engine()
+{
+    return sim_engine;
+}
@@ -6,24 +6,36 @@
 #include <utility>
 #include <body.hpp>
 #include <barnes_hut_tree.hpp>
+#include <trajectory.hpp>
+#include <initial_conditions.hpp>
+#include <collision.hpp>
+#include <particle_mesh.hpp>
+#include <engine.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
 
 
 namespace simulation
 {
     /**
      * @brief The n_body_sim class represents an n body simulation. It provides the functionality for initializing
-     *        an n body simulation in an encapsulated way.
+     *        an n body simulation in an encapsulated way, and renders the bodies of the engine that steps them.
     */
     class n_body_sim
     {
         private:
-            std::vector<body*> bodies;
+            engine sim_engine;
             sf::RenderWindow window;
             sf::Clock Clock;
+            std::string recording_path;
+            std::unique_ptr<trajectory_writer> recorder;
 
-            void init();
-            
-            void init_barnes_hut();
+            void run(solver_type solver);
+
+            void record_frame();
+
+            void draw_bodies();
 
             void add_body(double _mass, int _radius, bool _inplace = false, std::pair<double, double> position = std::make_pair(0.0, 0.0), std::pair<double, double> velocity = std::make_pair(0.0, 0.0));
 
@@ -33,9 +45,25 @@ namespace simulation
             
             ~n_body_sim();
 
-            void random_sim_init(size_t num_bodies, bool b_h_flag);
+            void random_sim_init(size_t num_bodies, solver_type solver);
+
+            void circular_orbit(solver_type solver);
+
+            void file_init(const std::string& path, solver_type solver);
+
+            void distribution_init(distribution kind, size_t num_bodies, double total_mass, std::uint64_t seed, solver_type solver);
+
+            void set_collision_mode(collision_mode mode);
+
+            void set_particle_mesh(size_t mesh_size, mass_assignment scheme, bool p3m);
+
+            void set_autotune(double tolerance, size_t retune_interval = 500);
+
+            void record(const std::string& path);
+
+            void playback(const std::string& path);
 
-            void circular_orbit(bool b_h_flag);
+            engine& get_engine();
 
            
     };
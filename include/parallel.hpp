@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace simulation
+{
+    /**
+     * @brief Gets the number of worker threads used by the parallel helpers.
+    */
+    inline size_t worker_count()
+    {
+        return std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+
+    /**
+     * @brief Splits [begin, end) into one contiguous block per worker and runs func(block_begin, block_end, worker)
+     *        for every block on its own thread. Small ranges run inline on the calling thread. If blocks throw, every
+     *        thread is still joined and the first exception is rethrown on the calling thread.
+     *
+     * @param begin First index of the range.
+     * @param end One past the last index of the range.
+     * @param func Callable invoked once per block.
+     * @param min_block Smallest block worth handing to a thread of its own.
+    */
+    template <typename F>
+    void parallel_for_blocks(size_t begin, size_t end, F&& func, size_t min_block = 1024)
+    {
+        size_t count = end > begin ? end - begin : 0;
+        size_t workers = std::min(worker_count(), std::max<size_t>(1, count / min_block));
+
+        if(workers <= 1)
+        {
+            func(begin, end, size_t{0});
+            return;
+        }
+
+        std::vector<std::thread> threads;
+        threads.reserve(workers - 1);
+
+        std::mutex error_lock;
+        std::exception_ptr error;
+
+        auto run_block = [&func, &error_lock, &error](size_t block_begin, size_t block_end, size_t w)
+        {
+            try
+            {
+                func(block_begin, block_end, w);
+            }
+            catch(...)
+            {
+                std::lock_guard<std::mutex> guard{error_lock};
+                if(!error)
+                {
+                    error = std::current_exception();
+                }
+            }
+        };
+
+        size_t block = (count + workers - 1) / workers;
+
+        for(size_t w = 1; w < workers; ++w)
+        {
+            size_t block_begin = std::min(end, begin + w * block);
+            size_t block_end = std::min(end, block_begin + block);
+
+            threads.emplace_back([&run_block, block_begin, block_end, w]() { run_block(block_begin, block_end, w); });
+        }
+
+        run_block(begin, std::min(end, begin + block), size_t{0});
+
+        for(std::thread& t : threads)
+        {
+            t.join();
+        }
+
+        if(error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+
+    /**
+     * @brief Runs func(i) for every i in [begin, end), spread across the worker threads.
+    */
+    template <typename F>
+    void parallel_for(size_t begin, size_t end, F&& func, size_t min_block = 1024)
+    {
+        parallel_for_blocks(begin, end, [&func](size_t block_begin, size_t block_end, size_t)
+        {
+            for(size_t i = block_begin; i < block_end; ++i)
+            {
+                func(i);
+            }
+        }, min_block);
+    }
+}
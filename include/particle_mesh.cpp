@@ -0,0 +1,469 @@
+#include <particle_mesh.hpp>
+#include <settings.hpp>
+#include <task_scheduler.hpp>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+
+namespace
+{
+    /**
+     * @brief Cubic smoothstep, rising from 0 at t = 0 to 1 at t = 1. Splits the force between mesh and direct sum in P3M.
+    */
+    double smoothstep(double t)
+    {
+        if(t >= 1)
+        {
+            return 1;
+        }
+        return t * t * (3 - 2 * t);
+    }
+}
+
+/**
+ * @brief In-place iterative radix-2 FFT of n complex values spaced stride apart.
+ *
+ * @param data First value of the sequence.
+ * @param n Length of the sequence, must be a power of two.
+ * @param stride Distance between consecutive values of the sequence.
+ * @param inverse True for the inverse transform, which is scaled by 1/n.
+*/
+void simulation::fft(std::complex<double>* data, size_t n, size_t stride, bool inverse)
+{
+    for(size_t i = 1, j = 0; i < n; ++i)
+    {
+        size_t bit = n >> 1;
+        for(; j & bit; bit >>= 1)
+        {
+            j ^= bit;
+        }
+        j ^= bit;
+
+        if(i < j)
+        {
+            std::swap(data[i * stride], data[j * stride]);
+        }
+    }
+
+    for(size_t length = 2; length <= n; length <<= 1)
+    {
+        double angle = 2 * M_PI / length * (inverse ? 1 : -1);
+        std::complex<double> step_root{std::cos(angle), std::sin(angle)};
+
+        for(size_t start = 0; start < n; start += length)
+        {
+            std::complex<double> root{1, 0};
+
+            for(size_t k = 0; k < length / 2; ++k)
+            {
+                std::complex<double> even = data[(start + k) * stride];
+                std::complex<double> odd = data[(start + k + length / 2) * stride] * root;
+
+                data[(start + k) * stride] = even + odd;
+                data[(start + k + length / 2) * stride] = even - odd;
+
+                root *= step_root;
+            }
+        }
+    }
+
+    if(inverse)
+    {
+        for(size_t i = 0; i < n; ++i)
+        {
+            data[i * stride] /= static_cast<double>(n);
+        }
+    }
+}
+
+/**
+ * @brief In-place 2D FFT of an n x n row-major grid. Rows and then columns are transformed in parallel.
+ *
+ * @param data The grid.
+ * @param n Side length of the grid, must be a power of two.
+ * @param inverse True for the inverse transform.
+ * @param scheduler Scheduler transforming the rows and columns.
+*/
+void simulation::fft_2d(std::vector<std::complex<double>>& data, size_t n, bool inverse, task_scheduler& scheduler)
+{
+    scheduler.parallel_for(0, n, 16, [&](size_t block_begin, size_t block_end)
+    {
+        for(size_t row = block_begin; row < block_end; ++row)
+        {
+            fft(data.data() + row * n, n, 1, inverse);
+        }
+    });
+
+    scheduler.parallel_for(0, n, 16, [&](size_t block_begin, size_t block_end)
+    {
+        for(size_t col = block_begin; col < block_end; ++col)
+        {
+            fft(data.data() + col, n, n, inverse);
+        }
+    });
+}
+
+/**
+ * @brief Construct a new particle_mesh object.
+ *
+ * @param _mesh_size Number of mesh cells along each side of the window, must be a power of two.
+ * @param _scheme Mass assignment scheme.
+ * @param _p3m True to add the direct-sum short-range correction.
+ * @param _cutoff_cells Radius of the short-range correction in mesh cells.
+*/
+simulation::particle_mesh::particle_mesh(size_t _mesh_size, mass_assignment _scheme, bool _p3m, double _cutoff_cells)
+: mesh_size{_mesh_size}, scheme{_scheme}, p3m{_p3m}, cutoff_cells{_cutoff_cells}
+{
+    if(mesh_size == 0 || (mesh_size & (mesh_size - 1)) != 0)
+    {
+        throw std::invalid_argument("particle mesh size must be a power of two");
+    }
+}
+
+/**
+ * @brief Computes the acceleration induced on every body by all other bodies.
+ *
+ * @param bodies The bodies in the sim.
+ * @param accels Resized to bodies.size(), accels[i] receives the acceleration of bodies[i].
+ * @param scheduler Scheduler running every stage in parallel.
+*/
+void simulation::particle_mesh::compute(const std::vector<body*>& bodies, std::vector<sf::Vector2<double>>& accels, task_scheduler& scheduler)
+{
+    if(kernel_dimensions != settings::DIMENSIONS)
+    {
+        build_kernels(scheduler);
+    }
+
+    accels.assign(bodies.size(), sf::Vector2<double>{0, 0});
+
+    deposit(bodies, scheduler);
+    solve(scheduler);
+    interpolate(bodies, accels, scheduler);
+
+    if(p3m)
+    {
+        short_range(bodies, accels, scheduler);
+    }
+}
+
+/**
+ * @brief Gets the radius within which pairs are summed directly when P3M is enabled.
+*/
+double simulation::particle_mesh::cutoff() const
+{
+    return cutoff_cells * std::min(cell_width, cell_height);
+}
+
+/**
+ * @brief Precomputes the FFT of the force kernel on the zero-padded 2M x 2M mesh. Rebuilt whenever the window,
+ *        and so the cell size, changes.
+*/
+void simulation::particle_mesh::build_kernels(task_scheduler& scheduler)
+{
+    kernel_dimensions = settings::DIMENSIONS;
+    cell_width = static_cast<double>(settings::DIMENSIONS.first) / mesh_size;
+    cell_height = static_cast<double>(settings::DIMENSIONS.second) / mesh_size;
+
+    size_t padded = 2 * mesh_size;
+    double softening = std::min(cell_width, cell_height);
+    double r_cut = cutoff();
+
+    kernel_x_hat.assign(padded * padded, 0);
+    kernel_y_hat.assign(padded * padded, 0);
+
+    scheduler.parallel_for(0, padded, 16, [&](size_t block_begin, size_t block_end)
+    {
+        for(size_t row = block_begin; row < block_end; ++row)
+        {
+            long offset_y = row < mesh_size ? static_cast<long>(row) : static_cast<long>(row) - static_cast<long>(padded);
+
+            for(size_t col = 0; col < padded; ++col)
+            {
+                long offset_x = col < mesh_size ? static_cast<long>(col) : static_cast<long>(col) - static_cast<long>(padded);
+
+                if(row == mesh_size || col == mesh_size || (offset_x == 0 && offset_y == 0))
+                {
+                    continue;
+                }
+
+                double dx = offset_x * cell_width;
+                double dy = offset_y * cell_height;
+                double dist = std::sqrt(dx * dx + dy * dy);
+
+                double scale{};
+                if(p3m)
+                {
+                    scale = smoothstep(dist / r_cut) / (dist * dist * dist);
+                }
+                else
+                {
+                    double soft_dist = std::max(dist, softening);
+                    scale = 1 / (soft_dist * soft_dist * soft_dist);
+                }
+
+                kernel_x_hat[row * padded + col] = -settings::G * dx * scale;
+                kernel_y_hat[row * padded + col] = -settings::G * dy * scale;
+            }
+        }
+    });
+
+    fft_2d(kernel_x_hat, padded, false, scheduler);
+    fft_2d(kernel_y_hat, padded, false, scheduler);
+
+    density_hat.assign(padded * padded, 0);
+    field_x.assign(padded * padded, 0);
+    field_y.assign(padded * padded, 0);
+}
+
+/**
+ * @brief Computes the mesh cells and weights that a coordinate is assigned to along one axis.
+ *
+ * @param coordinate Position along the axis.
+ * @param cell_extent Size of a mesh cell along the axis.
+ * @param indices Receives up to three cell indices.
+ * @param weights Receives the weight of each cell.
+ * @return size_t Number of cells written.
+*/
+size_t simulation::particle_mesh::assignment_weights(double coordinate, double cell_extent, size_t* indices, double* weights) const
+{
+    double u = coordinate / cell_extent - 0.5;
+    long last = static_cast<long>(mesh_size) - 1;
+
+    auto clamp_index = [last](long i) { return static_cast<size_t>(std::clamp(i, 0L, last)); };
+
+    if(scheme == mass_assignment::cic)
+    {
+        long i0 = static_cast<long>(std::floor(u));
+        double f = u - i0;
+
+        indices[0] = clamp_index(i0);
+        indices[1] = clamp_index(i0 + 1);
+        weights[0] = 1 - f;
+        weights[1] = f;
+
+        return 2;
+    }
+
+    long i = std::lround(u);
+    double d = u - i;
+
+    indices[0] = clamp_index(i - 1);
+    indices[1] = clamp_index(i);
+    indices[2] = clamp_index(i + 1);
+    weights[0] = 0.5 * (0.5 - d) * (0.5 - d);
+    weights[1] = 0.75 - d * d;
+    weights[2] = 0.5 * (0.5 + d) * (0.5 + d);
+
+    return 3;
+}
+
+/**
+ * @brief Deposits the mass of the bodies onto the mesh. Every worker deposits into its own mesh and the meshes are
+ *        summed into the zero-padded density grid.
+*/
+void simulation::particle_mesh::deposit(const std::vector<body*>& bodies, task_scheduler& scheduler)
+{
+    size_t cells = mesh_size * mesh_size;
+
+    worker_density.resize(scheduler.num_threads());
+
+    scheduler.for_each_worker([&](size_t worker, size_t num_workers)
+    {
+        std::pair<size_t, size_t> block = static_block(worker, num_workers, bodies.size());
+        size_t block_begin = block.first;
+        size_t block_end = block.second;
+
+        std::vector<double>& density = worker_density[worker];
+        density.assign(cells, 0);
+
+        size_t x_indices[3], y_indices[3];
+        double x_weights[3], y_weights[3];
+
+        for(size_t i = block_begin; i < block_end; ++i)
+        {
+            sf::Vector2<double> pos = bodies[i] -> get_position();
+            double mass = bodies[i] -> get_mass();
+
+            size_t nx = assignment_weights(pos.x, cell_width, x_indices, x_weights);
+            size_t ny = assignment_weights(pos.y, cell_height, y_indices, y_weights);
+
+            for(size_t a = 0; a < ny; ++a)
+            {
+                for(size_t b = 0; b < nx; ++b)
+                {
+                    density[y_indices[a] * mesh_size + x_indices[b]] += mass * y_weights[a] * x_weights[b];
+                }
+            }
+        }
+    });
+
+    size_t padded = 2 * mesh_size;
+    std::fill(density_hat.begin(), density_hat.end(), 0);
+
+    scheduler.parallel_for(0, mesh_size, 16, [&](size_t block_begin, size_t block_end)
+    {
+        for(size_t row = block_begin; row < block_end; ++row)
+        {
+            for(size_t col = 0; col < mesh_size; ++col)
+            {
+                double mass{};
+                for(std::vector<double>& density : worker_density)
+                {
+                    if(!density.empty())
+                    {
+                        mass += density[row * mesh_size + col];
+                    }
+                }
+                density_hat[row * padded + col] = mass;
+            }
+        }
+    });
+
+    for(std::vector<double>& density : worker_density)
+    {
+        density.clear();
+    }
+}
+
+/**
+ * @brief Convolves the density with the force kernel in Fourier space, leaving the acceleration field on the mesh
+ *        in the first M x M cells of field_x and field_y.
+*/
+void simulation::particle_mesh::solve(task_scheduler& scheduler)
+{
+    size_t padded = 2 * mesh_size;
+
+    fft_2d(density_hat, padded, false, scheduler);
+
+    scheduler.parallel_for(0, density_hat.size(), 1024, [&](size_t block_begin, size_t block_end)
+    {
+        for(size_t i = block_begin; i < block_end; ++i)
+        {
+            field_x[i] = density_hat[i] * kernel_x_hat[i];
+            field_y[i] = density_hat[i] * kernel_y_hat[i];
+        }
+    });
+
+    fft_2d(field_x, padded, true, scheduler);
+    fft_2d(field_y, padded, true, scheduler);
+}
+
+/**
+ * @brief Interpolates the mesh acceleration field back to the bodies with the same scheme used for the deposit,
+ *        so a body exerts no force on itself.
+*/
+void simulation::particle_mesh::interpolate(const std::vector<body*>& bodies, std::vector<sf::Vector2<double>>& accels, task_scheduler& scheduler) const
+{
+    size_t padded = 2 * mesh_size;
+
+    scheduler.parallel_for(0, bodies.size(), 1024, [&](size_t block_begin, size_t block_end)
+    {
+        for(size_t i = block_begin; i < block_end; ++i)
+        {
+            size_t x_indices[3], y_indices[3];
+            double x_weights[3], y_weights[3];
+
+            sf::Vector2<double> pos = bodies[i] -> get_position();
+
+            size_t nx = assignment_weights(pos.x, cell_width, x_indices, x_weights);
+            size_t ny = assignment_weights(pos.y, cell_height, y_indices, y_weights);
+
+            sf::Vector2<double> accel{0, 0};
+
+            for(size_t a = 0; a < ny; ++a)
+            {
+                for(size_t b = 0; b < nx; ++b)
+                {
+                    size_t cell = y_indices[a] * padded + x_indices[b];
+                    double weight = y_weights[a] * x_weights[b];
+
+                    accel += sf::Vector2<double>{field_x[cell].real(), field_y[cell].real()} * weight;
+                }
+            }
+
+            accels[i] = accel;
+        }
+    });
+}
+
+/**
+ * @brief P3M short-range correction. Pairs closer than the cutoff are found through a cell list on the mesh and
+ *        summed with body::calc_accel, weighted by the part of the force the mesh kernel leaves out.
+*/
+void simulation::particle_mesh::short_range(const std::vector<body*>& bodies, std::vector<sf::Vector2<double>>& accels, task_scheduler& scheduler)
+{
+    size_t cells = mesh_size * mesh_size;
+    double r_cut = cutoff();
+
+    auto cell_index = [this](sf::Vector2<double> pos, long& cx, long& cy)
+    {
+        long last = static_cast<long>(mesh_size) - 1;
+        cx = std::clamp(static_cast<long>(std::floor(pos.x / cell_width)), 0L, last);
+        cy = std::clamp(static_cast<long>(std::floor(pos.y / cell_height)), 0L, last);
+    };
+
+    std::vector<std::uint32_t> body_cell(bodies.size());
+    cell_start.assign(cells + 1, 0);
+
+    for(size_t i = 0; i < bodies.size(); ++i)
+    {
+        long cx, cy;
+        cell_index(bodies[i] -> get_position(), cx, cy);
+        body_cell[i] = static_cast<std::uint32_t>(cy * mesh_size + cx);
+        ++cell_start[body_cell[i] + 1];
+    }
+    std::partial_sum(cell_start.begin(), cell_start.end(), cell_start.begin());
+
+    std::vector<std::uint32_t> fill(cell_start.begin(), cell_start.end() - 1);
+    cell_entries.resize(bodies.size());
+    for(size_t i = 0; i < bodies.size(); ++i)
+    {
+        cell_entries[fill[body_cell[i]]++] = static_cast<std::uint32_t>(i);
+    }
+
+    long reach_x = static_cast<long>(std::ceil(r_cut / cell_width));
+    long reach_y = static_cast<long>(std::ceil(r_cut / cell_height));
+    long last = static_cast<long>(mesh_size) - 1;
+
+    scheduler.parallel_for(0, bodies.size(), 1024, [&](size_t block_begin, size_t block_end)
+    {
+        for(size_t i = block_begin; i < block_end; ++i)
+        {
+            body* b = bodies[i];
+            sf::Vector2<double> pos = b -> get_position();
+
+            long cx, cy;
+            cell_index(pos, cx, cy);
+
+            sf::Vector2<double> correction{0, 0};
+
+            for(long y = std::max(0L, cy - reach_y); y <= std::min(last, cy + reach_y); ++y)
+            {
+                for(long x = std::max(0L, cx - reach_x); x <= std::min(last, cx + reach_x); ++x)
+                {
+                    size_t cell = y * mesh_size + x;
+
+                    for(std::uint32_t e = cell_start[cell]; e < cell_start[cell + 1]; ++e)
+                    {
+                        body* other = bodies[cell_entries[e]];
+                        if(other == b)
+                        {
+                            continue;
+                        }
+
+                        sf::Vector2<double> delta = other -> get_position() - pos;
+                        double dist = std::sqrt(delta.x * delta.x + delta.y * delta.y);
+
+                        if(dist < r_cut)
+                        {
+                            correction += b -> calc_accel(other) * (1 - smoothstep(dist / r_cut));
+                        }
+                    }
+                }
+            }
+
+            accels[i] += correction;
+        }
+    });
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <SFML/System/Vector2.hpp>
+#include <body.hpp>
+
+namespace simulation
+{
+    class task_scheduler;
+
+    /**
+     * @brief Scheme used to deposit mass onto the mesh and to interpolate accelerations back to the bodies.
+    */
+    enum class mass_assignment
+    {
+        cic,
+        tsc
+    };
+
+    /**
+     * @brief The particle_mesh object computes accelerations on a uniform mesh spanning the window. Mass is deposited
+     *        onto the mesh, convolved with the gravitational force kernel through a zero-padded FFT (the Green's
+     *        function solution of the Poisson problem for the sim's force law) and interpolated back to the bodies.
+     *        Step cost is O(N + M log M) for N bodies and M mesh cells. With P3M enabled, the mesh only carries the
+     *        long-range part of the force and pairs closer than a few cells are summed directly with body::calc_accel.
+    */
+    class particle_mesh
+    {
+        private:
+            size_t mesh_size{};
+            mass_assignment scheme{};
+            bool p3m{};
+            double cutoff_cells{};
+
+            double cell_width{};
+            double cell_height{};
+            std::pair<int, int> kernel_dimensions{};
+
+            std::vector<std::complex<double>> kernel_x_hat;
+            std::vector<std::complex<double>> kernel_y_hat;
+            std::vector<std::complex<double>> density_hat;
+            std::vector<std::complex<double>> field_x;
+            std::vector<std::complex<double>> field_y;
+            std::vector<std::vector<double>> worker_density;
+
+            std::vector<std::uint32_t> cell_start;
+            std::vector<std::uint32_t> cell_entries;
+
+            void build_kernels(task_scheduler& scheduler);
+
+            void deposit(const std::vector<body*>& bodies, task_scheduler& scheduler);
+
+            void solve(task_scheduler& scheduler);
+
+            void interpolate(const std::vector<body*>& bodies, std::vector<sf::Vector2<double>>& accels, task_scheduler& scheduler) const;
+
+            void short_range(const std::vector<body*>& bodies, std::vector<sf::Vector2<double>>& accels, task_scheduler& scheduler);
+
+            size_t assignment_weights(double coordinate, double cell_extent, size_t* indices, double* weights) const;
+
+            double cutoff() const;
+
+        public:
+
+            particle_mesh(size_t _mesh_size = 128, mass_assignment _scheme = mass_assignment::cic, bool _p3m = false, double _cutoff_cells = 3);
+
+            void compute(const std::vector<body*>& bodies, std::vector<sf::Vector2<double>>& accels, task_scheduler& scheduler);
+    };
+
+    void fft(std::complex<double>* data, size_t n, size_t stride, bool inverse);
+
+    void fft_2d(std::vector<std::complex<double>>& data, size_t n, bool inverse, task_scheduler& scheduler);
+}
@@ -0,0 +1,344 @@
+#include <placement.hpp>
+#include <task_scheduler.hpp>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include <sys/mman.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace
+{
+    /**
+     * @brief Arrays smaller than this come from the heap, mapping them is not worth a system call.
+    */
+    const size_t MIN_MAPPED_BYTES = 1 << 16;
+
+    const size_t HUGE_PAGE_BYTES = 1 << 21;
+
+    /**
+     * @brief Gets whether an array of count elements is mapped by placed_allocate(). placed_deallocate() makes the
+     *        same decision from the same arguments.
+    */
+    bool is_mapped(size_t bytes, simulation::task_scheduler* scheduler, bool huge_pages, const std::string* spill_directory)
+    {
+        return (scheduler != nullptr || huge_pages || spill_directory != nullptr) && bytes >= MIN_MAPPED_BYTES;
+    }
+
+    /**
+     * @brief Maps length bytes of a new file in a directory. The file is unlinked right away, so it is reclaimed as
+     *        soon as the mapping goes away, even if the process dies.
+    */
+    void* map_spill_file(const std::string& directory, size_t length)
+    {
+        std::string pattern = directory + "/gravitysim-XXXXXX";
+
+        int fd = mkstemp(pattern.data());
+        if(fd < 0)
+        {
+            throw std::bad_alloc{};
+        }
+
+        unlink(pattern.c_str());
+
+        if(ftruncate(fd, static_cast<off_t>(length)) != 0)
+        {
+            close(fd);
+            throw std::bad_alloc{};
+        }
+
+        void* addr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+
+        if(addr == MAP_FAILED)
+        {
+            throw std::bad_alloc{};
+        }
+
+        return addr;
+    }
+
+    /**
+     * @brief Applies an madvise hint to the whole pages covering [first, last).
+    */
+    void advise_pages(const void* first, const void* last, int advice)
+    {
+        if(first == nullptr || last <= first)
+        {
+            return;
+        }
+
+        uintptr_t page_size = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+        uintptr_t begin = reinterpret_cast<uintptr_t>(first) / page_size * page_size;
+        uintptr_t end = reinterpret_cast<uintptr_t>(last);
+
+        madvise(reinterpret_cast<void*>(begin), end - begin, advice);
+    }
+
+    /**
+     * @brief Gets the length of the mapping holding bytes bytes, rounded up to whole huge pages when they are used.
+    */
+    size_t mapping_length(size_t bytes, bool huge_pages)
+    {
+        size_t unit = huge_pages ? HUGE_PAGE_BYTES : static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+        return (bytes + unit - 1) / unit * unit;
+    }
+
+#ifdef __linux__
+    /**
+     * @brief Gets the cores the process may run on, captured before any thread is pinned.
+    */
+    const std::vector<int>& allowed_cpus()
+    {
+        static const std::vector<int> cpus = []()
+        {
+            std::vector<int> allowed;
+
+            cpu_set_t set;
+            CPU_ZERO(&set);
+
+            if(sched_getaffinity(0, sizeof(set), &set) == 0)
+            {
+                for(int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+                {
+                    if(CPU_ISSET(cpu, &set))
+                    {
+                        allowed.push_back(cpu);
+                    }
+                }
+            }
+
+            return allowed;
+        }();
+
+        return cpus;
+    }
+#endif
+}
+
+/**
+ * @brief Pins the calling thread to the worker-th core the process may run on (wrapping around when there are more
+ *        workers than cores). Does nothing on systems without thread affinity.
+ *
+ * @param worker Index of the worker running on the thread.
+*/
+void simulation::pin_current_thread(size_t worker)
+{
+#ifdef __linux__
+    const std::vector<int>& cpus = allowed_cpus();
+
+    if(cpus.empty())
+    {
+        return;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpus[worker % cpus.size()], &set);
+
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    (void)worker;
+#endif
+}
+
+/**
+ * @brief Gets the cores the calling thread may run on, so a thread pinned for a while can be given them back.
+ *
+ * @return std::vector<int> The cores of the thread's affinity mask, empty on systems without thread affinity.
+*/
+std::vector<int> simulation::current_affinity()
+{
+    std::vector<int> cpus;
+
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    if(pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0)
+    {
+        for(int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        {
+            if(CPU_ISSET(cpu, &set))
+            {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+#endif
+
+    return cpus;
+}
+
+/**
+ * @brief Lets the calling thread run on the given cores. Does nothing if the list is empty.
+ *
+ * @param cpus Cores returned by current_affinity().
+*/
+void simulation::set_current_affinity(const std::vector<int>& cpus)
+{
+#ifdef __linux__
+    if(cpus.empty())
+    {
+        return;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    for(int cpu : cpus)
+    {
+        CPU_SET(cpu, &set);
+    }
+
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    (void)cpus;
+#endif
+}
+
+/**
+ * @brief Allocates an array for placed_allocator. Large arrays are mapped, from a file of the spill directory if one
+ *        is given and anonymously otherwise, advised to use huge pages if asked (anonymous mappings only), and have
+ *        each page first touched by the worker of the scheduler whose static_block() holds the page's first byte.
+ *
+ * @param count Number of elements.
+ * @param elem_size Size of one element in bytes.
+ * @param scheduler Scheduler whose workers first touch the pages, or nullptr to leave placement to the first writer.
+ * @param huge_pages True to ask for transparent huge pages.
+ * @param spill_directory Directory of the file backing the array, or nullptr.
+ * @return void* The uninitialized array.
+*/
+void* simulation::placed_allocate(size_t count, size_t elem_size, task_scheduler* scheduler, bool huge_pages, const std::string* spill_directory)
+{
+    size_t bytes = count * elem_size;
+
+    if(!is_mapped(bytes, scheduler, huge_pages, spill_directory))
+    {
+        return ::operator new(bytes);
+    }
+
+    size_t length = mapping_length(bytes, huge_pages);
+
+    void* addr = nullptr;
+
+    if(spill_directory != nullptr)
+    {
+        addr = map_spill_file(*spill_directory, length);
+    }
+    else
+    {
+        addr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(addr == MAP_FAILED)
+        {
+            throw std::bad_alloc{};
+        }
+
+#ifdef MADV_HUGEPAGE
+        if(huge_pages)
+        {
+            madvise(addr, length, MADV_HUGEPAGE);
+        }
+#endif
+    }
+
+    if(scheduler != nullptr)
+    {
+        unsigned char* data = static_cast<unsigned char*>(addr);
+        size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+        scheduler -> for_each_worker([data, count, elem_size, page_size](size_t worker, size_t num_workers)
+        {
+            std::pair<size_t, size_t> block = static_block(worker, num_workers, count);
+
+            //each page is touched once, by the worker whose block holds the page's first byte
+            size_t first_page = (block.first * elem_size + page_size - 1) / page_size * page_size;
+
+            for(size_t offset = first_page; offset < block.second * elem_size; offset += page_size)
+            {
+                data[offset] = 0;
+            }
+        });
+    }
+
+    return addr;
+}
+
+/**
+ * @brief Releases an array allocated by placed_allocate() with the same arguments.
+ *
+ * @param ptr The array.
+ * @param count Number of elements.
+ * @param elem_size Size of one element in bytes.
+ * @param scheduler Scheduler given to placed_allocate(), only compared with nullptr.
+ * @param huge_pages True if huge pages were asked for.
+ * @param spill_directory Spill directory given to placed_allocate().
+*/
+void simulation::placed_deallocate(void* ptr, size_t count, size_t elem_size, task_scheduler* scheduler, bool huge_pages, const std::string* spill_directory)
+{
+    size_t bytes = count * elem_size;
+
+    if(!is_mapped(bytes, scheduler, huge_pages, spill_directory))
+    {
+        ::operator delete(ptr);
+        return;
+    }
+
+    munmap(ptr, mapping_length(bytes, huge_pages));
+}
+
+/**
+ * @brief Asks the kernel to start reading the pages of [first, last) ahead of their use, so that streaming through a
+ *        spilled array overlaps I/O with work.
+ *
+ * @param first Start of the range.
+ * @param last End of the range.
+*/
+void simulation::prefetch_range(const void* first, const void* last)
+{
+    advise_pages(first, last, MADV_WILLNEED);
+}
+
+/**
+ * @brief Marks the pages of [first, last) as done with for now, so that under memory pressure they are reclaimed
+ *        (written back to their file when spilled) before pages still to be used. Contents are kept.
+ *
+ * @param first Start of the range.
+ * @param last End of the range.
+*/
+void simulation::retire_range(const void* first, const void* last)
+{
+#ifdef MADV_COLD
+    advise_pages(first, last, MADV_COLD);
+#else
+    (void)first;
+    (void)last;
+#endif
+}
+
+/**
+ * @brief Gives back the whole pages lying inside [first, last) of anonymous memory, so that the next write to each of
+ *        them places it anew on the memory node of the writing core. Their contents are lost; pages only partly
+ *        inside the range are left alone. Lets an array that cannot use placed_allocator be placed by the workers
+ *        that refill it.
+ *
+ * @param first Start of the range.
+ * @param last End of the range.
+*/
+void simulation::discard_pages(const void* first, const void* last)
+{
+    uintptr_t page_size = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    uintptr_t begin = (reinterpret_cast<uintptr_t>(first) + page_size - 1) / page_size * page_size;
+    uintptr_t end = reinterpret_cast<uintptr_t>(last) / page_size * page_size;
+
+    if(first == nullptr || end <= begin)
+    {
+        return;
+    }
+
+    madvise(reinterpret_cast<void*>(begin), end - begin, MADV_DONTNEED);
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace simulation
+{
+    class task_scheduler;
+
+    /**
+     * @brief Gets the block of [0, count) owned by a worker when the range is split statically into one contiguous
+     *        block per worker. Memory first touched by a worker and the bodies it later works on use the same blocks.
+     *
+     * @param worker Index of the worker.
+     * @param num_workers Number of workers.
+     * @param count Number of elements.
+     * @return std::pair<size_t, size_t> The block [first, second) of the worker.
+    */
+    inline std::pair<size_t, size_t> static_block(size_t worker, size_t num_workers, size_t count)
+    {
+        size_t block = (count + num_workers - 1) / num_workers;
+        size_t first = std::min(count, worker * block);
+
+        return std::make_pair(first, std::min(count, first + block));
+    }
+
+    void pin_current_thread(size_t worker);
+
+    std::vector<int> current_affinity();
+
+    void set_current_affinity(const std::vector<int>& cpus);
+
+    void* placed_allocate(size_t count, size_t elem_size, task_scheduler* scheduler, bool huge_pages, const std::string* spill_directory);
+
+    void placed_deallocate(void* ptr, size_t count, size_t elem_size, task_scheduler* scheduler, bool huge_pages, const std::string* spill_directory);
+
+    void prefetch_range(const void* first, const void* last);
+
+    void retire_range(const void* first, const void* last);
+
+    void discard_pages(const void* first, const void* last);
+
+    /**
+     * @brief Allocator placing large arrays for NUMA machines. Arrays are mapped directly (backed by transparent huge
+     *        pages if asked) and, given a scheduler, their pages are first touched by the worker that owns them under
+     *        static_block(), so each page lands on the memory node of the core that works on it. Given a spill
+     *        directory, arrays are instead mapped from unlinked files in that directory, so the kernel can write
+     *        cold pages back to disk and the arrays may outgrow RAM. Without any of these it behaves like
+     *        std::allocator. Only the scheduler's address is kept, so the allocator stays valid for deallocation
+     *        after the scheduler is gone.
+    */
+    template <typename T>
+    class placed_allocator
+    {
+        public:
+            using value_type = T;
+            using propagate_on_container_copy_assignment = std::true_type;
+            using propagate_on_container_move_assignment = std::true_type;
+            using propagate_on_container_swap = std::true_type;
+
+            task_scheduler* scheduler{};
+
+            bool huge_pages{};
+
+            std::shared_ptr<const std::string> spill_directory{};
+
+            placed_allocator() = default;
+
+            /**
+             * @brief Construct a new placed_allocator object.
+             *
+             * @param _scheduler Scheduler whose workers first touch the pages, or nullptr.
+             * @param _huge_pages True to ask for transparent huge pages.
+             * @param _spill_directory Directory of the files backing the arrays, or nullptr for anonymous memory.
+            */
+            placed_allocator(task_scheduler* _scheduler, bool _huge_pages, std::shared_ptr<const std::string> _spill_directory = nullptr)
+            : scheduler{_scheduler}, huge_pages{_huge_pages}, spill_directory{std::move(_spill_directory)} {}
+
+            template <typename U>
+            placed_allocator(const placed_allocator<U>& other)
+            : scheduler{other.scheduler}, huge_pages{other.huge_pages}, spill_directory{other.spill_directory} {}
+
+            T* allocate(size_t count)
+            {
+                return static_cast<T*>(placed_allocate(count, sizeof(T), scheduler, huge_pages, spill_directory.get()));
+            }
+
+            void deallocate(T* ptr, size_t count)
+            {
+                placed_deallocate(ptr, count, sizeof(T), scheduler, huge_pages, spill_directory.get());
+            }
+
+            template <typename U>
+            bool operator==(const placed_allocator<U>& other) const
+            {
+                return scheduler == other.scheduler && huge_pages == other.huge_pages && spill_directory == other.spill_directory;
+            }
+
+            template <typename U>
+            bool operator!=(const placed_allocator<U>& other) const
+            {
+                return !(*this == other);
+            }
+    };
+}
@@ -0,0 +1,137 @@
+#include <solver.hpp>
+#include <barnes_hut_tree.hpp>
+#include <particle_mesh.hpp>
+#include <task_scheduler.hpp>
+#include <interaction_cache.hpp>
+#include <force_kernels.hpp>
+#include <unordered_map>
+
+/**
+ * @brief Gets the name of an engine, as printed in logs.
+ *
+ * @param solver The engine.
+ * @return const char* Its name.
+*/
+const char* simulation::solver_name(solver_type solver)
+{
+    switch(solver)
+    {
+        case solver_type::brute_force:
+            return "brute force";
+        case solver_type::barnes_hut:
+            return "Barnes Hut";
+        case solver_type::particle_mesh:
+            return "particle mesh";
+    }
+
+    return "unknown";
+}
+
+/**
+ * @brief Computes the acceleration induced on each target by all sources through direct summation. The sources are
+ *        copied into arrays once and every target sums them with the active force kernels.
+ *
+ * @param sources The bodies exerting the forces.
+ * @param targets The bodies whose accelerations are calculated.
+ * @param accels Resized to targets.size(), accels[i] receives the acceleration of targets[i].
+ * @param scheduler Scheduler running the sums in parallel, or nullptr to sum on the calling thread.
+*/
+void simulation::brute_force_accels(const std::vector<body*>& sources, const std::vector<body*>& targets, std::vector<sf::Vector2<double>>& accels, task_scheduler* scheduler)
+{
+    const size_t grain = 16;
+
+    accels.resize(targets.size());
+
+    std::vector<double> source_x(sources.size());
+    std::vector<double> source_y(sources.size());
+    std::vector<double> source_mass(sources.size());
+    std::vector<double> source_radius(sources.size());
+
+    std::unordered_map<const body*, size_t> source_index;
+    source_index.reserve(sources.size());
+
+    for(size_t j = 0; j < sources.size(); ++j)
+    {
+        sf::Vector2<double> position = sources[j] -> get_position();
+
+        source_x[j] = position.x;
+        source_y[j] = position.y;
+        source_mass[j] = sources[j] -> get_mass();
+        source_radius[j] = sources[j] -> get_radius();
+
+        source_index.emplace(sources[j], j);
+    }
+
+    auto sum_block = [&](size_t block_begin, size_t block_end)
+    {
+        accumulate_kernel accumulate = active_kernels().accumulate;
+
+        for(size_t i = block_begin; i < block_end; ++i)
+        {
+            sf::Vector2<double> position = targets[i] -> get_position();
+            double radius = targets[i] -> get_radius();
+
+            auto self = source_index.find(targets[i]);
+            size_t skip = self != source_index.end() ? self -> second : sources.size();
+
+            double accel_x = 0;
+            double accel_y = 0;
+
+            accumulate(position.x, position.y, radius, source_x.data(), source_y.data(), source_mass.data(), source_radius.data(), skip, accel_x, accel_y);
+
+            if(skip < sources.size())
+            {
+                size_t rest = skip + 1;
+
+                accumulate(position.x, position.y, radius, source_x.data() + rest, source_y.data() + rest, source_mass.data() + rest, source_radius.data() + rest, sources.size() - rest, accel_x, accel_y);
+            }
+
+            accels[i] = sf::Vector2<double>{accel_x, accel_y};
+        }
+    };
+
+    if(scheduler != nullptr)
+    {
+        scheduler -> parallel_for(0, targets.size(), grain, sum_block);
+    }
+    else
+    {
+        sum_block(0, targets.size());
+    }
+}
+
+/**
+ * @brief Computes the acceleration of every body with the engine and parameters of a solver configuration.
+ *
+ * @param config The engine and its parameters. The thread count is applied by the owner of the scheduler.
+ * @param bodies The bodies in the sim.
+ * @param accels Resized to bodies.size(), accels[i] receives the acceleration of bodies[i].
+ * @param scheduler Scheduler running the work.
+ * @param mesh Particle mesh used by solver_type::particle_mesh.
+ * @param cache Interaction lists kept across steps by solver_type::barnes_hut when config.list_margin is positive,
+ *        or nullptr to walk a new tree every call.
+*/
+void simulation::compute_accels(const solver_config& config, const std::vector<body*>& bodies, std::vector<sf::Vector2<double>>& accels, task_scheduler& scheduler, particle_mesh& mesh, interaction_cache* cache)
+{
+    switch(config.solver)
+    {
+        case solver_type::brute_force:
+            brute_force_accels(bodies, bodies, accels, &scheduler);
+            break;
+        case solver_type::barnes_hut:
+        {
+            if(cache != nullptr && config.list_margin > 0)
+            {
+                cache -> compute(bodies, accels, scheduler, config.opening_angle, config.leaf_size, config.list_margin);
+                break;
+            }
+
+            b_h_tree body_tree{bodies, &scheduler, config.opening_angle, config.leaf_size};
+            body_tree.compute_accels(bodies, accels, &scheduler);
+            break;
+        }
+        case solver_type::particle_mesh:
+            mesh.compute(bodies, accels, scheduler);
+            break;
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <settings.hpp>
+#include <SFML/System/Vector2.hpp>
+#include <body.hpp>
+#include <parallel.hpp>
+
+namespace simulation
+{
+    class task_scheduler;
+
+    class particle_mesh;
+
+    class interaction_cache;
+
+    /**
+     * @brief The engines available to compute the accelerations of the bodies.
+    */
+    enum class solver_type
+    {
+        brute_force,
+        barnes_hut,
+        particle_mesh
+    };
+
+    /**
+     * @brief A complete choice of engine and tuning parameters for computing accelerations. pin_threads pins the
+     *        workers to cores and places the bodies and tree arrays on the memory node of the worker using them.
+     *        A positive list_margin makes Barnes Hut reuse its interaction lists across steps until a body moves
+     *        further than half the margin. It only pays off when most steps reuse the lists, i.e. when bodies move
+     *        much less than the margin per step; the lists of a wider margin are longer, so with fast bodies or
+     *        leaves of one body they cost more than walking the tree afresh.
+    */
+    struct solver_config
+    {
+        solver_type solver{solver_type::barnes_hut};
+
+        double opening_angle{settings::RATIO_EPSILON};
+
+        size_t leaf_size{1};
+
+        size_t num_threads{worker_count()};
+
+        bool pin_threads{};
+
+        double list_margin{};
+    };
+
+    const char* solver_name(solver_type solver);
+
+    void brute_force_accels(const std::vector<body*>& sources, const std::vector<body*>& targets, std::vector<sf::Vector2<double>>& accels, task_scheduler* scheduler);
+
+    void compute_accels(const solver_config& config, const std::vector<body*>& bodies, std::vector<sf::Vector2<double>>& accels, task_scheduler& scheduler, particle_mesh& mesh, interaction_cache* cache = nullptr);
+}
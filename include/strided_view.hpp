@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+
+namespace simulation
+{
+    /**
+     * @brief Read-only view of count elements of type T laid out stride bytes apart, such as one field of every
+     *        element of an array of structs. Reading through the view never copies the underlying objects; the
+     *        view is invalidated by anything that moves them.
+    */
+    template <typename T>
+    class strided_view
+    {
+        private:
+            const unsigned char* data{};
+            size_t count{};
+            size_t stride{};
+
+        public:
+
+            /**
+             * @brief Random access iterator over the elements of a strided_view.
+            */
+            class iterator
+            {
+                private:
+                    const unsigned char* current{};
+                    size_t stride{};
+
+                public:
+                    using iterator_category = std::random_access_iterator_tag;
+                    using value_type = T;
+                    using difference_type = std::ptrdiff_t;
+                    using pointer = const T*;
+                    using reference = const T&;
+
+                    iterator() = default;
+
+                    iterator(const unsigned char* _current, size_t _stride) : current{_current}, stride{_stride} {}
+
+                    reference operator*() const { return *reinterpret_cast<const T*>(current); }
+
+                    pointer operator->() const { return reinterpret_cast<const T*>(current); }
+
+                    reference operator[](difference_type n) const { return *(*this + n); }
+
+                    iterator& operator++() { current += stride; return *this; }
+
+                    iterator operator++(int) { iterator old = *this; current += stride; return old; }
+
+                    iterator& operator--() { current -= stride; return *this; }
+
+                    iterator operator--(int) { iterator old = *this; current -= stride; return old; }
+
+                    iterator& operator+=(difference_type n) { current += n * static_cast<difference_type>(stride); return *this; }
+
+                    iterator& operator-=(difference_type n) { current -= n * static_cast<difference_type>(stride); return *this; }
+
+                    iterator operator+(difference_type n) const { iterator moved = *this; return moved += n; }
+
+                    iterator operator-(difference_type n) const { iterator moved = *this; return moved -= n; }
+
+                    difference_type operator-(const iterator& other) const { return (current - other.current) / static_cast<difference_type>(stride); }
+
+                    bool operator==(const iterator& other) const { return current == other.current; }
+
+                    bool operator!=(const iterator& other) const { return current != other.current; }
+
+                    bool operator<(const iterator& other) const { return current < other.current; }
+
+                    bool operator>(const iterator& other) const { return current > other.current; }
+
+                    bool operator<=(const iterator& other) const { return current <= other.current; }
+
+                    bool operator>=(const iterator& other) const { return current >= other.current; }
+
+                    friend iterator operator+(difference_type n, const iterator& it) { return it + n; }
+            };
+
+            strided_view() = default;
+
+            /**
+             * @brief Construct a new strided_view object.
+             *
+             * @param first The first element, or nullptr for an empty view.
+             * @param _count Number of elements.
+             * @param _stride Distance in bytes between two consecutive elements.
+            */
+            strided_view(const T* first, size_t _count, size_t _stride = sizeof(T))
+            : data{reinterpret_cast<const unsigned char*>(first)}, count{first ? _count : 0}, stride{_stride}
+            {
+
+            }
+
+            const T& operator[](size_t i) const
+            {
+                return *reinterpret_cast<const T*>(data + i * stride);
+            }
+
+            size_t size() const
+            {
+                return count;
+            }
+
+            bool empty() const
+            {
+                return count == 0;
+            }
+
+            /**
+             * @brief Gets the distance in bytes between two consecutive elements, equal to sizeof(T) when the
+             *        elements are contiguous.
+            */
+            size_t stride_bytes() const
+            {
+                return stride;
+            }
+
+            iterator begin() const
+            {
+                return iterator{data, stride};
+            }
+
+            iterator end() const
+            {
+                return iterator{data + count * stride, stride};
+            }
+    };
+}
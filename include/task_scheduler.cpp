@@ -0,0 +1,323 @@
+#include <task_scheduler.hpp>
+
+namespace
+{
+    /**
+     * @brief Scheduler owning the current thread and the index of its deque, set for pool threads only.
+    */
+    thread_local const simulation::task_scheduler* current_scheduler = nullptr;
+
+    thread_local size_t current_worker = 0;
+
+    const int SPINS_BEFORE_SLEEP = 64;
+}
+
+//task group definitions//
+
+/**
+ * @brief Construct a new task_group object.
+ *
+ * @param _scheduler Scheduler that will run the tasks of the group.
+*/
+simulation::task_group::task_group(task_scheduler& _scheduler)
+: scheduler{_scheduler}
+{
+
+}
+
+/**
+ * @brief Waits for any task still pending, tasks must not outlive the group. Exceptions of the tasks are dropped,
+ *        the group is usually being unwound by another one already.
+*/
+simulation::task_group::~task_group()
+{
+    drain();
+}
+
+/**
+ * @brief Queues a task on the deque of the calling thread.
+ *
+ * @param func The work to run.
+*/
+void simulation::task_group::spawn(std::function<void()> func)
+{
+    pending.fetch_add(1, std::memory_order_relaxed);
+    scheduler.push(task_scheduler::task{std::move(func), this});
+}
+
+/**
+ * @brief Returns once every task of the group has finished, running queued tasks in the meantime, and rethrows the
+ *        first exception thrown by one of them.
+*/
+void simulation::task_group::wait()
+{
+    drain();
+
+    std::exception_ptr exception;
+    {
+        std::lock_guard<std::mutex> guard{error_lock};
+        std::swap(exception, error);
+    }
+
+    if(exception)
+    {
+        std::rethrow_exception(exception);
+    }
+}
+
+/**
+ * @brief Returns once every task of the group has finished, running queued tasks in the meantime.
+*/
+void simulation::task_group::drain()
+{
+    size_t index = scheduler.current_index();
+
+    while(pending.load(std::memory_order_acquire) != 0)
+    {
+        if(!scheduler.try_run_one(index))
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+/**
+ * @brief Keeps the exception thrown by a task of the group for wait(), unless an earlier one is kept already.
+*/
+void simulation::task_group::fail(std::exception_ptr exception)
+{
+    std::lock_guard<std::mutex> guard{error_lock};
+
+    if(!error)
+    {
+        error = exception;
+    }
+}
+
+//scheduler definitions//
+
+/**
+ * @brief Construct a new task_scheduler object and starts its worker threads. The thread that waits on a task_group
+ *        takes part in the work, so num_threads - 1 threads are started. When pinned, worker i runs on the i-th core
+ *        of the process, and the constructing thread, which works as worker 0, is pinned to the first core
+ *        until the scheduler is destroyed.
+ *
+ * @param num_threads Total number of threads working on tasks.
+ * @param pin_threads True to pin every worker to its own core.
+*/
+simulation::task_scheduler::task_scheduler(size_t num_threads, bool pin_threads)
+: pinned{pin_threads}
+{
+    num_threads = std::max<size_t>(1, num_threads);
+
+    for(size_t i = 0; i < num_threads; ++i)
+    {
+        queues.push_back(std::make_unique<worker_queue>());
+    }
+
+    if(pinned)
+    {
+        creator = std::this_thread::get_id();
+        creator_affinity = current_affinity();
+
+        pin_current_thread(0);
+    }
+
+    for(size_t i = 1; i < num_threads; ++i)
+    {
+        threads.emplace_back(&task_scheduler::worker_loop, this, i);
+    }
+}
+
+/**
+ * @brief Stops and joins the worker threads. A pinned scheduler gives the thread that created it back the cores it
+ *        could run on before, if that thread is the one destroying it.
+*/
+simulation::task_scheduler::~task_scheduler()
+{
+    {
+        std::lock_guard<std::mutex> guard{sleep_lock};
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for(std::thread& t : threads)
+    {
+        t.join();
+    }
+
+    if(pinned && std::this_thread::get_id() == creator)
+    {
+        set_current_affinity(creator_affinity);
+    }
+}
+
+/**
+ * @brief Gets the number of threads working on tasks, including the waiting thread.
+*/
+size_t simulation::task_scheduler::num_threads() const
+{
+    return queues.size();
+}
+
+/**
+ * @brief Gets whether every worker is pinned to its own core.
+*/
+bool simulation::task_scheduler::is_pinned() const
+{
+    return pinned;
+}
+
+/**
+ * @brief Gets the deque owned by the calling thread. Threads outside the pool share deque 0.
+*/
+size_t simulation::task_scheduler::current_index() const
+{
+    return current_scheduler == this ? current_worker : 0;
+}
+
+/**
+ * @brief Pushes a task at the back of the calling thread's deque and wakes a sleeping worker.
+*/
+void simulation::task_scheduler::push(task new_task)
+{
+    worker_queue& queue = *queues[current_index()];
+    {
+        std::lock_guard<std::mutex> guard{queue.lock};
+        queue.tasks.push_back(std::move(new_task));
+    }
+
+    queued.fetch_add(1, std::memory_order_release);
+
+    {
+        std::lock_guard<std::mutex> guard{sleep_lock};
+    }
+    wake.notify_one();
+}
+
+/**
+ * @brief Queues a task that only the thread owning deque index may run, and wakes every sleeping worker since the
+ *        owner cannot be woken alone.
+*/
+void simulation::task_scheduler::push_affine(size_t index, task new_task)
+{
+    worker_queue& queue = *queues[index];
+    {
+        std::lock_guard<std::mutex> guard{queue.lock};
+        queue.affine.push_back(std::move(new_task));
+    }
+
+    queue.affine_queued.fetch_add(1, std::memory_order_release);
+
+    {
+        std::lock_guard<std::mutex> guard{sleep_lock};
+    }
+    wake.notify_all();
+}
+
+/**
+ * @brief Runs one task: an affine task of the thread if any, else one taken from the back of the thread's own deque,
+ *        else one stolen from the front of another deque.
+ *
+ * @param index Index of the calling thread's deque.
+ * @return bool True if a task was run.
+*/
+bool simulation::task_scheduler::try_run_one(size_t index)
+{
+    task next{};
+    bool found = false;
+    bool affine = false;
+
+    {
+        worker_queue& own = *queues[index];
+        std::lock_guard<std::mutex> guard{own.lock};
+        if(!own.affine.empty())
+        {
+            next = std::move(own.affine.front());
+            own.affine.pop_front();
+            found = true;
+            affine = true;
+        }
+        else if(!own.tasks.empty())
+        {
+            next = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            found = true;
+        }
+    }
+
+    for(size_t offset = 1; !found && offset < queues.size(); ++offset)
+    {
+        worker_queue& victim = *queues[(index + offset) % queues.size()];
+        std::lock_guard<std::mutex> guard{victim.lock};
+        if(!victim.tasks.empty())
+        {
+            next = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            found = true;
+        }
+    }
+
+    if(!found)
+    {
+        return false;
+    }
+
+    if(affine)
+    {
+        queues[index] -> affine_queued.fetch_sub(1, std::memory_order_relaxed);
+    }
+    else
+    {
+        queued.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    try
+    {
+        next.func();
+    }
+    catch(...)
+    {
+        next.group -> fail(std::current_exception());
+    }
+
+    next.group -> pending.fetch_sub(1, std::memory_order_release);
+
+    return true;
+}
+
+/**
+ * @brief Main loop of a pool thread. Runs and steals tasks, spinning briefly and then sleeping when there is no work
+ *        it may run: no stealable task anywhere and no affine task of its own.
+*/
+void simulation::task_scheduler::worker_loop(size_t index)
+{
+    current_scheduler = this;
+    current_worker = index;
+
+    if(pinned)
+    {
+        pin_current_thread(index);
+    }
+
+    int idle_spins = 0;
+
+    while(!stopping.load(std::memory_order_acquire))
+    {
+        if(try_run_one(index))
+        {
+            idle_spins = 0;
+            continue;
+        }
+
+        if(++idle_spins < SPINS_BEFORE_SLEEP)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> guard{sleep_lock};
+        wake.wait(guard, [this, index]() { return stopping.load() || queued.load() != 0 || queues[index] -> affine_queued.load() != 0; });
+        idle_spins = 0;
+    }
+}
@@ -0,0 +1,216 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <parallel.hpp>
+#include <placement.hpp>
+
+namespace simulation
+{
+    class task_scheduler;
+
+    /**
+     * @brief A set of tasks spawned together that can be waited on. Waiting threads run queued tasks (their own
+     *        first, then stolen ones) instead of blocking, so tasks can spawn and wait on nested groups. The first
+     *        exception thrown by a task of the group is rethrown by wait().
+    */
+    class task_group
+    {
+        private:
+            task_scheduler& scheduler;
+            std::atomic<size_t> pending{0};
+            std::mutex error_lock;
+            std::exception_ptr error;
+
+            friend class task_scheduler;
+
+            void drain();
+
+            void fail(std::exception_ptr exception);
+
+        public:
+
+            task_group(task_scheduler& _scheduler);
+
+            ~task_group();
+
+            void spawn(std::function<void()> func);
+
+            void wait();
+    };
+
+    /**
+     * @brief The task_scheduler object is a small work-stealing runtime. Every thread owns a deque of tasks: it pushes
+     *        and pops work at the back of its own deque (depth first, cache friendly) while idle threads steal from
+     *        the front of other deques (the oldest and usually largest pieces of work). This keeps all cores busy
+     *        on recursive, unevenly sized work such as building and walking the tree of a clustered distribution.
+     *        Work that must run on a given thread, such as first touching memory or walking the bodies whose pages
+     *        that thread placed, goes through for_each_worker() instead and is never stolen.
+    */
+    class task_scheduler
+    {
+        private:
+
+            /**
+             * @brief A unit of work and the group it belongs to.
+            */
+            struct task
+            {
+                std::function<void()> func;
+
+                task_group* group{};
+            };
+
+            /**
+             * @brief Per-thread deque of tasks. Affine tasks can only be run by the owning thread, so they are counted
+             *        apart from queued and only wake their owner.
+            */
+            struct worker_queue
+            {
+                std::mutex lock;
+
+                std::deque<task> tasks;
+
+                std::deque<task> affine;
+
+                std::atomic<size_t> affine_queued{0};
+            };
+
+            std::vector<std::unique_ptr<worker_queue>> queues;
+            std::vector<std::thread> threads;
+            std::atomic<size_t> queued{0};
+            std::atomic<bool> stopping{false};
+            std::mutex sleep_lock;
+            std::condition_variable wake;
+            bool pinned{};
+            std::thread::id creator;
+            std::vector<int> creator_affinity;
+
+            friend class task_group;
+
+            size_t current_index() const;
+
+            void push(task new_task);
+
+            void push_affine(size_t index, task new_task);
+
+            bool try_run_one(size_t index);
+
+            void worker_loop(size_t index);
+
+        public:
+
+            task_scheduler(size_t num_threads = worker_count(), bool pin_threads = false);
+
+            ~task_scheduler();
+
+            task_scheduler(const task_scheduler&) = delete;
+
+            task_scheduler& operator=(const task_scheduler&) = delete;
+
+            size_t num_threads() const;
+
+            bool is_pinned() const;
+
+            template <typename F>
+            void parallel_for(size_t begin, size_t end, size_t grain, const F& func);
+
+            template <typename F>
+            void for_each_worker(const F& func);
+
+            template <typename F>
+            void parallel_for_static(size_t begin, size_t end, const F& func);
+    };
+
+    /**
+     * @brief Runs func(block_begin, block_end) over [begin, end) by recursively splitting the range in halves and
+     *        spawning one half as a task, down to blocks of at most grain elements.
+     *
+     * @param begin First index of the range.
+     * @param end One past the last index of the range.
+     * @param grain Largest block run as a single task.
+     * @param func Callable invoked once per block.
+    */
+    template <typename F>
+    void task_scheduler::parallel_for(size_t begin, size_t end, size_t grain, const F& func)
+    {
+        if(end - begin <= grain || end <= begin)
+        {
+            if(end > begin)
+            {
+                func(begin, end);
+            }
+            return;
+        }
+
+        size_t middle = begin + (end - begin) / 2;
+
+        task_group group{*this};
+        group.spawn([this, middle, end, grain, &func]() { parallel_for(middle, end, grain, func); });
+        parallel_for(begin, middle, grain, func);
+        group.wait();
+    }
+
+    /**
+     * @brief Runs func(worker, num_threads()) once on every thread of the scheduler, each call on the thread owning
+     *        that worker index, and returns when all calls have finished.
+     *
+     * @param func Callable invoked once per worker.
+    */
+    template <typename F>
+    void task_scheduler::for_each_worker(const F& func)
+    {
+        size_t own = current_index();
+        size_t count = num_threads();
+
+        task_group group{*this};
+
+        for(size_t w = 0; w < count; ++w)
+        {
+            if(w != own)
+            {
+                group.pending.fetch_add(1, std::memory_order_relaxed);
+                push_affine(w, task{[&func, w, count]() { func(w, count); }, &group});
+            }
+        }
+
+        func(own, count);
+        group.wait();
+    }
+
+    /**
+     * @brief Runs func(block_begin, block_end) over [begin, end) split into one static_block() per worker, each block
+     *        on its own worker. Unlike parallel_for(), the same worker always gets the same block, so it works on the
+     *        memory it first touched.
+     *
+     * @param begin First index of the range.
+     * @param end One past the last index of the range.
+     * @param func Callable invoked once per non-empty block.
+    */
+    template <typename F>
+    void task_scheduler::parallel_for_static(size_t begin, size_t end, const F& func)
+    {
+        if(end <= begin)
+        {
+            return;
+        }
+
+        for_each_worker([begin, end, &func](size_t worker, size_t num_workers)
+        {
+            std::pair<size_t, size_t> block = static_block(worker, num_workers, end - begin);
+
+            if(block.second > block.first)
+            {
+                func(begin + block.first, begin + block.second);
+            }
+        });
+    }
+}
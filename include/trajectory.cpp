@@ -0,0 +1,295 @@
+#include <trajectory.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace
+{
+    const char TRAJECTORY_MAGIC[8] = {'G', 'S', 'I', 'M', 'T', 'R', 'J', '\0'};
+
+    //version 2 stores a body count and per-body radii in every frame instead of a radii block after the header
+    const std::uint32_t TRAJECTORY_VERSION = 2;
+
+    const size_t FRAMES_OFFSET = sizeof(simulation::trajectory_header);
+
+    /**
+     * @brief Number of frames between two updates of the frame count in the header of a recording.
+    */
+    const std::uint64_t FRAME_COUNT_INTERVAL = 64;
+
+    /**
+     * @brief Gets the size in bytes of a single frame with room for num_bodies bodies, padded to 8 bytes.
+    */
+    size_t frame_stride_for(std::uint64_t num_bodies)
+    {
+        size_t body_bytes = num_bodies * 3 * sizeof(float);
+        body_bytes = (body_bytes + 7) & ~static_cast<size_t>(7);
+
+        return sizeof(double) + sizeof(std::uint64_t) + body_bytes;
+    }
+}
+
+//writer definitions//
+
+/**
+ * @brief Creates a trajectory file and writes its header.
+ *
+ * @param path Path of the trajectory file, it is truncated if it already exists.
+ * @param bodies The bodies that will be recorded. Later frames may hold fewer bodies but never more.
+*/
+simulation::trajectory_writer::trajectory_writer(const std::string& path, const std::vector<body*>& bodies)
+: out{path, std::ios::binary | std::ios::trunc}, frame_buffer((frame_stride_for(bodies.size()) - sizeof(double) - sizeof(std::uint64_t)) / sizeof(float)), num_bodies{bodies.size()}
+{
+    if(!out)
+    {
+        throw std::runtime_error("could not open trajectory file " + path);
+    }
+
+    trajectory_header header{};
+    std::memcpy(header.magic, TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC));
+    header.version = TRAJECTORY_VERSION;
+    header.num_bodies = num_bodies;
+    header.num_frames = 0;
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+/**
+ * @brief Patches the final frame count into the header and closes the trajectory file.
+*/
+simulation::trajectory_writer::~trajectory_writer()
+{
+    write_frame_count();
+}
+
+/**
+ * @brief Patches the number of frames written so far into the header and returns to the end of the file.
+*/
+void simulation::trajectory_writer::write_frame_count()
+{
+    out.seekp(offsetof(trajectory_header, num_frames));
+    out.write(reinterpret_cast<const char*>(&num_frames), sizeof(num_frames));
+    out.seekp(0, std::ios::end);
+    out.flush();
+}
+
+/**
+ * @brief Appends the current positions and radii of the bodies as a new frame. The header's frame count is brought
+ *        up to date every FRAME_COUNT_INTERVAL frames, so a recording cut short stays readable.
+ *
+ * @param time Simulation time of the frame in seconds.
+ * @param bodies The bodies being recorded.
+*/
+void simulation::trajectory_writer::write_frame(double time, const std::vector<body*>& bodies)
+{
+    if(bodies.size() > num_bodies)
+    {
+        throw std::runtime_error("trajectory frame holds more bodies than the recording");
+    }
+
+    for(size_t i = 0; i < bodies.size(); ++i)
+    {
+        sf::Vector2<double> pos = bodies[i] -> get_position();
+        frame_buffer[3 * i] = static_cast<float>(pos.x);
+        frame_buffer[3 * i + 1] = static_cast<float>(pos.y);
+        frame_buffer[3 * i + 2] = static_cast<float>(bodies[i] -> get_radius());
+    }
+
+    std::uint64_t count = bodies.size();
+
+    out.write(reinterpret_cast<const char*>(&time), sizeof(time));
+    out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    out.write(reinterpret_cast<const char*>(frame_buffer.data()), frame_buffer.size() * sizeof(float));
+
+    ++num_frames;
+
+    if(num_frames % FRAME_COUNT_INTERVAL == 0)
+    {
+        write_frame_count();
+    }
+}
+
+//reader definitions//
+
+/**
+ * @brief Memory maps a trajectory file for playback.
+ *
+ * @param path Path of the trajectory file recorded by a trajectory_writer.
+*/
+simulation::trajectory_reader::trajectory_reader(const std::string& path)
+: page_size{static_cast<size_t>(sysconf(_SC_PAGESIZE))}
+{
+    fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+        throw std::runtime_error("could not open trajectory file " + path);
+    }
+
+    struct stat file_stat{};
+    if(fstat(fd, &file_stat) != 0 || static_cast<size_t>(file_stat.st_size) < sizeof(trajectory_header))
+    {
+        close(fd);
+        throw std::runtime_error("trajectory file " + path + " is truncated");
+    }
+
+    mapping_size = static_cast<size_t>(file_stat.st_size);
+
+    void* addr = mmap(nullptr, mapping_size, PROT_READ, MAP_SHARED, fd, 0);
+    if(addr == MAP_FAILED)
+    {
+        close(fd);
+        throw std::runtime_error("could not map trajectory file " + path);
+    }
+
+    mapping = static_cast<unsigned char*>(addr);
+    header = reinterpret_cast<const trajectory_header*>(mapping);
+
+    bool valid = std::memcmp(header -> magic, TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC)) == 0
+        && header -> version == TRAJECTORY_VERSION
+        && header -> num_bodies <= (SIZE_MAX - sizeof(double) - sizeof(std::uint64_t) - 8) / (3 * sizeof(float));
+
+    if(valid)
+    {
+        frame_stride = frame_stride_for(header -> num_bodies);
+        frame_count = (mapping_size - FRAMES_OFFSET) / frame_stride;
+
+        valid = header -> num_frames <= frame_count;
+    }
+
+    if(!valid)
+    {
+        munmap(mapping, mapping_size);
+        close(fd);
+        throw std::runtime_error(path + " is not a valid trajectory file");
+    }
+
+    madvise(mapping, mapping_size, MADV_SEQUENTIAL);
+}
+
+/**
+ * @brief Unmaps and closes the trajectory file.
+*/
+simulation::trajectory_reader::~trajectory_reader()
+{
+    munmap(mapping, mapping_size);
+    close(fd);
+}
+
+/**
+ * @brief Gets the number of bodies stored in every frame.
+*/
+size_t simulation::trajectory_reader::num_bodies() const
+{
+    return header -> num_bodies;
+}
+
+/**
+ * @brief Gets the number of whole frames in the file. It is derived from the file size rather than read from the
+ *        header, so the frames of a recording still in progress or cut short are played too.
+*/
+size_t simulation::trajectory_reader::num_frames() const
+{
+    return frame_count;
+}
+
+/**
+ * @brief Gets a zero-copy view of a frame.
+ *
+ * @param index Index of the frame, must be smaller than num_frames().
+ * @return trajectory_frame View whose bodies point into the mapping.
+*/
+simulation::trajectory_frame simulation::trajectory_reader::frame(size_t index) const
+{
+    if(index >= frame_count)
+    {
+        throw std::out_of_range("trajectory frame index out of range");
+    }
+
+    const unsigned char* frame_start = mapping + FRAMES_OFFSET + index * frame_stride;
+
+    std::uint64_t count{};
+
+    trajectory_frame view{};
+    std::memcpy(&view.time, frame_start, sizeof(double));
+    std::memcpy(&count, frame_start + sizeof(double), sizeof(count));
+    view.bodies = reinterpret_cast<const float*>(frame_start + sizeof(double) + sizeof(std::uint64_t));
+    view.num_bodies = std::min<size_t>(count, header -> num_bodies);
+
+    return view;
+}
+
+/**
+ * @brief Finds the last frame recorded at or before a given simulation time. Only the time stamp of
+ *        O(log frames) frames is touched.
+ *
+ * @param time Simulation time to seek to.
+ * @return size_t Index of the frame to display for that time.
+*/
+size_t simulation::trajectory_reader::frame_at_time(double time) const
+{
+    size_t low = 0;
+    size_t high = num_frames();
+
+    while(low < high)
+    {
+        size_t mid = low + (high - low) / 2;
+
+        if(frame(mid).time <= time)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    return low == 0 ? 0 : low - 1;
+}
+
+/**
+ * @brief Issues a readahead hint for the frames following (or preceding, when playing backwards)
+ *        the frame being displayed.
+ *
+ * @param index The frame currently being displayed.
+ * @param readahead Number of frames to prefetch.
+ * @param forward True if playback moves towards later frames.
+*/
+void simulation::trajectory_reader::prefetch(size_t index, size_t readahead, bool forward) const
+{
+    if(forward)
+    {
+        advise(index + 1, readahead, MADV_WILLNEED);
+    }
+    else
+    {
+        size_t first = index > readahead ? index - readahead : 0;
+        advise(first, index - first, MADV_WILLNEED);
+    }
+}
+
+/**
+ * @brief Applies an madvise hint to a range of frames, clamped to the frames in the file.
+*/
+void simulation::trajectory_reader::advise(size_t first_frame, size_t count, int advice) const
+{
+    if(first_frame >= num_frames() || count == 0)
+    {
+        return;
+    }
+
+    size_t last_frame = std::min(first_frame + count, num_frames());
+
+    size_t begin = FRAMES_OFFSET + first_frame * frame_stride;
+    size_t end = FRAMES_OFFSET + last_frame * frame_stride;
+
+    begin -= begin % page_size;
+
+    madvise(mapping + begin, end - begin, advice);
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <body.hpp>
+
+namespace simulation
+{
+    /**
+     * @brief On-disk header of a recorded trajectory. The header is followed by num_frames fixed size frames;
+     *        num_frames is refreshed periodically while recording, and readers count the whole frames in the file.
+     *        Each frame holds the simulation time as a double, the number of bodies in the frame as a uint64
+     *        and room for num_bodies x, y, radius float triplets. Frames may hold fewer bodies than num_bodies
+     *        once bodies have merged.
+    */
+    struct trajectory_header
+    {
+        char magic[8];
+
+        std::uint32_t version;
+
+        std::uint32_t reserved;
+
+        std::uint64_t num_bodies;
+
+        std::uint64_t num_frames;
+    };
+
+    /**
+     * @brief A read-only view of a single frame inside a memory mapped trajectory. Nothing is copied, bodies
+     *        points straight into the mapping and holds an x, y, radius triplet per body.
+    */
+    struct trajectory_frame
+    {
+        double time{};
+
+        const float* bodies{};
+
+        size_t num_bodies{};
+    };
+
+    /**
+     * @brief The trajectory_writer object appends frames of a running simulation to a trajectory file.
+    */
+    class trajectory_writer
+    {
+        private:
+            std::ofstream out;
+            std::vector<float> frame_buffer;
+            std::uint64_t num_bodies{};
+            std::uint64_t num_frames{};
+
+            void write_frame_count();
+
+        public:
+
+            trajectory_writer(const std::string& path, const std::vector<body*>& bodies);
+
+            ~trajectory_writer();
+
+            void write_frame(double time, const std::vector<body*>& bodies);
+    };
+
+    /**
+     * @brief The trajectory_reader object memory maps a trajectory file and hands out zero-copy frame views,
+     *        issuing readahead hints for the frames that will be needed next.
+    */
+    class trajectory_reader
+    {
+        private:
+            int fd{-1};
+            unsigned char* mapping{};
+            size_t mapping_size{};
+            const trajectory_header* header{};
+            size_t frame_stride{};
+            size_t frame_count{};
+            size_t page_size{};
+
+            void advise(size_t first_frame, size_t count, int advice) const;
+
+        public:
+
+            trajectory_reader(const std::string& path);
+
+            ~trajectory_reader();
+
+            trajectory_reader(const trajectory_reader&) = delete;
+
+            trajectory_reader& operator=(const trajectory_reader&) = delete;
+
+            size_t num_bodies() const;
+
+            size_t num_frames() const;
+
+            trajectory_frame frame(size_t index) const;
+
+            size_t frame_at_time(double time) const;
+
+            void prefetch(size_t index, size_t readahead, bool forward) const;
+    };
+}
@@ -0,0 +1,93 @@
+#include <settings.hpp>
+#include <engine.hpp>
+#include <initial_conditions.hpp>
+#include <force_kernels.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(int argc, char *argv[])
+{
+    bool pin_threads = false;
+    double list_margin = 0;
+    std::string spill_directory;
+    std::string kernel;
+    size_t diagnostics_interval = 0;
+    std::vector<char*> args;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(std::strcmp(argv[i], "--pin") == 0)
+        {
+            pin_threads = true;
+        }
+        else if(std::strcmp(argv[i], "--margin") == 0 && i + 1 < argc)
+        {
+            list_margin = std::strtod(argv[++i], nullptr);
+        }
+        else if(std::strcmp(argv[i], "--out-of-core") == 0 && i + 1 < argc)
+        {
+            spill_directory = argv[++i];
+        }
+        else if(std::strcmp(argv[i], "--kernel") == 0 && i + 1 < argc)
+        {
+            kernel = argv[++i];
+        }
+        else if(std::strcmp(argv[i], "--diagnostics") == 0 && i + 1 < argc)
+        {
+            diagnostics_interval = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else
+        {
+            args.push_back(argv[i]);
+        }
+    }
+
+    size_t num_bodies = args.size() > 0 ? std::strtoull(args[0], nullptr, 10) : 100000;
+    size_t num_steps = args.size() > 1 ? std::strtoull(args[1], nullptr, 10) : 10;
+
+    if(!kernel.empty() && !simulation::select_kernels(kernel))
+    {
+        std::cerr << "kernel " << kernel << " is not available, choose from: " << simulation::available_kernels() << std::endl;
+        return 1;
+    }
+
+    simulation::solver_config config{};
+    config.num_threads = args.size() > 2 ? std::strtoull(args[2], nullptr, 10) : simulation::worker_count();
+    config.pin_threads = pin_threads;
+    config.list_margin = list_margin;
+
+    simulation::engine sim{config};
+    sim.set_collision_mode(simulation::collision_mode::none);
+
+    if(!spill_directory.empty())
+    {
+        sim.set_out_of_core(spill_directory);
+    }
+
+    std::vector<body> initial;
+    simulation::generate(simulation::distribution::plummer, num_bodies, 1e6, 1, initial);
+    sim.add_bodies(std::move(initial));
+
+    sim.step(0.01);
+
+    sim.set_diagnostics(diagnostics_interval);
+
+    auto start = std::chrono::steady_clock::now();
+
+    sim.step(0.01, num_steps);
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << num_bodies << " bodies, " << config.num_threads << " threads" << (pin_threads ? " (pinned)" : "")
+              << (list_margin > 0 ? ", list margin " + std::to_string(list_margin) : std::string{})
+              << (spill_directory.empty() ? std::string{} : ", out of core in " + spill_directory)
+              << ", " << simulation::active_kernels().name << " kernels"
+              << (diagnostics_interval > 0 ? ", diagnostics every " + std::to_string(diagnostics_interval) + " steps" : std::string{})
+              << ": " << elapsed / num_steps << " s/step" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,128 @@
+#include <settings.hpp>
+#include <distributed_sim.hpp>
+#include <initial_conditions.hpp>
+#include <mpi.h>
+#include <chrono>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    /**
+     * @brief Parses a whole argument as a non-negative integer.
+     *
+     * @param text The argument.
+     * @param value Receives the integer.
+     * @return bool False if the argument is not a plain decimal number or does not fit.
+    */
+    bool parse_count(const char* text, size_t& value)
+    {
+        if(text[0] < '0' || text[0] > '9')
+        {
+            return false;
+        }
+
+        char* end{};
+        errno = 0;
+        unsigned long long parsed = std::strtoull(text, &end, 10);
+
+        if(*end != '\0' || errno == ERANGE)
+        {
+            return false;
+        }
+
+        value = static_cast<size_t>(parsed);
+        return true;
+    }
+
+    /**
+     * @brief Parses a whole argument as a finite positive number.
+     *
+     * @param text The argument.
+     * @param value Receives the number.
+     * @return bool False if the argument is not a number, not finite or not positive.
+    */
+    bool parse_positive(const char* text, double& value)
+    {
+        char* end{};
+        double parsed = std::strtod(text, &end);
+
+        if(end == text || *end != '\0' || !std::isfinite(parsed) || parsed <= 0)
+        {
+            return false;
+        }
+
+        value = parsed;
+        return true;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    MPI_Init(&argc, &argv);
+
+    size_t num_bodies = 100000;
+    size_t num_steps = 10;
+    double opening_angle = settings::RATIO_EPSILON;
+    size_t num_threads = 1;
+
+    bool valid = (argc <= 1 || parse_count(argv[1], num_bodies))
+        && (argc <= 2 || parse_count(argv[2], num_steps))
+        && (argc <= 3 || parse_positive(argv[3], opening_angle))
+        && (argc <= 4 || (parse_count(argv[4], num_threads) && num_threads > 0));
+
+    if(!valid)
+    {
+        int rank{};
+        MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+        if(rank == 0)
+        {
+            std::cerr << "usage: " << argv[0] << " [num_bodies] [num_steps] [opening_angle > 0] [threads_per_rank > 0]" << std::endl;
+        }
+
+        MPI_Finalize();
+        return 1;
+    }
+
+    {
+        simulation::distributed_sim sim{MPI_COMM_WORLD, opening_angle, num_threads};
+
+        std::vector<body> initial;
+        if(sim.get_rank() == 0)
+        {
+            simulation::generate(simulation::distribution::plummer, num_bodies, 1e6, 1, initial);
+        }
+
+        sim.scatter(initial);
+
+        for(size_t step = 0; step < num_steps; ++step)
+        {
+            auto start = std::chrono::steady_clock::now();
+
+            sim.step(0.01);
+
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            if(sim.get_rank() == 0)
+            {
+                std::cout << "step " << step << ": " << elapsed << " s" << std::endl;
+            }
+        }
+
+        std::vector<body> final_bodies;
+        sim.gather(final_bodies);
+
+        if(sim.get_rank() == 0)
+        {
+            std::cout << final_bodies.size() << " bodies" << std::endl;
+        }
+    }
+
+    MPI_Finalize();
+    return 0;
+}
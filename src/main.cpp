@@ -2,14 +2,92 @@
 #include <vector>
 #include <iostream>
 #include <n_body_sim.hpp>
+#include <initial_conditions.hpp>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
 
 int main(int argc, char const *argv[])
 {
     simulation::n_body_sim sim{};
-    
-    //sim.random_sim_init(25, true);
 
-    sim.circular_orbit(true);
+    std::string load_path;
+    std::string generate_kind;
+    size_t generate_count = 0;
+    std::uint64_t seed = 1;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(std::strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+        {
+            sim.record(argv[++i]);
+        }
+        else if(std::strcmp(argv[i], "--load") == 0 && i + 1 < argc)
+        {
+            load_path = argv[++i];
+        }
+        else if(std::strcmp(argv[i], "--generate") == 0 && i + 2 < argc)
+        {
+            generate_kind = argv[++i];
+            generate_count = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if(std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            seed = std::strtoull(argv[++i], nullptr, 10);
+        }
+    }
+
+    try
+    {
+        if(argc > 2 && std::string(argv[1]) == "--play")
+        {
+            sim.playback(argv[2]);
+            return 0;
+        }
+
+        if(!load_path.empty())
+        {
+            sim.file_init(load_path, simulation::solver_type::barnes_hut);
+            return 0;
+        }
+
+        if(!generate_kind.empty())
+        {
+            simulation::distribution kind{};
+
+            if(generate_kind == "plummer")
+            {
+                kind = simulation::distribution::plummer;
+            }
+            else if(generate_kind == "disk")
+            {
+                kind = simulation::distribution::exponential_disk;
+            }
+            else if(generate_kind == "cold")
+            {
+                kind = simulation::distribution::cold_collapse;
+            }
+            else
+            {
+                std::cerr << "unknown distribution " << generate_kind << ", choose from plummer, disk, cold" << std::endl;
+                return 1;
+            }
+
+            sim.distribution_init(kind, generate_count, 1e6, seed, simulation::solver_type::barnes_hut);
+            return 0;
+        }
+
+        //sim.random_sim_init(25, simulation::solver_type::barnes_hut);
+
+        sim.circular_orbit(simulation::solver_type::brute_force);
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
     return 0;
 }
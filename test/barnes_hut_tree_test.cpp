@@ -0,0 +1,89 @@
+#include <barnes_hut_tree.hpp>
+#include <initial_conditions.hpp>
+#include <task_scheduler.hpp>
+#include <check.hpp>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+namespace
+{
+    /**
+     * @brief Reference walk: the recursive descent over the node tree that the depth-first layout replaced, applying
+     *        far cells and leaf bodies one at a time through body::calc_accel.
+    */
+    sf::Vector2<double> recursive_accel(const std::shared_ptr<b_h_tree::b_h_node>& node, body* b, double opening_angle)
+    {
+        sf::Vector2<double> net_accel{0, 0};
+
+        if(node -> is_external())
+        {
+            for(size_t i = 0; i < node -> leaf_count; ++i)
+            {
+                if(node -> leaf_bodies[i] != b)
+                {
+                    net_accel += b -> calc_accel(node -> leaf_bodies[i]);
+                }
+            }
+        }
+        else if(node -> is_internal())
+        {
+            sf::Vector2<double> offset = node -> center_of_mass - b -> get_position();
+            double distance = std::hypot(offset.x, offset.y);
+
+            if(node -> width < opening_angle * distance)
+            {
+                body center_of_mass_rep{node -> total_mass, 0, true, node -> center_of_mass};
+
+                net_accel = b -> calc_accel(&center_of_mass_rep);
+            }
+            else
+            {
+                for(const std::shared_ptr<b_h_tree::b_h_node>& child : node -> children)
+                {
+                    net_accel += recursive_accel(child, b, opening_angle);
+                }
+            }
+        }
+
+        return net_accel;
+    }
+}
+
+int main()
+{
+    std::vector<body> store;
+    simulation::generate(simulation::distribution::plummer, 4000, 1e6, 3, store);
+
+    std::vector<body*> bodies;
+    for(body& b : store)
+    {
+        bodies.push_back(&b);
+    }
+
+    simulation::task_scheduler scheduler{3};
+
+    for(size_t leaf_size : {1, 8})
+    {
+        for(double opening_angle : {0.3, 0.5, 1.0})
+        {
+            b_h_tree tree{bodies, &scheduler, opening_angle, leaf_size};
+
+            std::vector<sf::Vector2<double>> accels;
+            tree.compute_accels(bodies, accels, &scheduler);
+
+            test::check(accels.size() == bodies.size(), "one acceleration per body");
+
+            for(size_t i = 0; i < bodies.size(); ++i)
+            {
+                sf::Vector2<double> expected = recursive_accel(tree.root, bodies[i], opening_angle);
+                double scale = std::max(std::hypot(expected.x, expected.y), 1e-300);
+
+                test::check(std::hypot(accels[i].x - expected.x, accels[i].y - expected.y) <= 1e-9 * scale, "stackless walk matches the recursive walk");
+                test::check(tree.get_accel(bodies[i]) == accels[i], "scheduled walk matches a single walk");
+            }
+        }
+    }
+
+    return 0;
+}
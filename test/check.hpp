@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+namespace test
+{
+    /**
+     * @brief Ends the test with a failure status if a condition does not hold.
+     *
+     * @param condition The condition checked.
+     * @param what Description of the condition, printed on failure.
+    */
+    inline void check(bool condition, const std::string& what)
+    {
+        if(!condition)
+        {
+            std::cerr << "FAILED: " << what << std::endl;
+            std::exit(1);
+        }
+    }
+
+    /**
+     * @brief Ends the test with a failure status if two values differ by more than a relative tolerance.
+     *
+     * @param value The value obtained.
+     * @param expected The value expected.
+     * @param tolerance Largest accepted |value - expected| / max(|expected|, 1).
+     * @param what Description of the value, printed on failure.
+    */
+    inline void check_close(double value, double expected, double tolerance, const std::string& what)
+    {
+        double scale = std::max(std::abs(expected), 1.0);
+
+        if(!(std::abs(value - expected) <= tolerance * scale))
+        {
+            std::cerr << "FAILED: " << what << ": got " << value << ", expected " << expected << std::endl;
+            std::exit(1);
+        }
+    }
+
+    /**
+     * @brief Gets a path for a scratch file in the system's temporary directory.
+     *
+     * @param name Name of the file.
+    */
+    inline std::string scratch_path(const std::string& name)
+    {
+        return (std::filesystem::temp_directory_path() / ("gravitysim_" + name)).string();
+    }
+}
@@ -0,0 +1,100 @@
+#include <engine.hpp>
+#include <initial_conditions.hpp>
+#include <check.hpp>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+    /**
+     * @brief Sums the mass, the momentum and the magnitude of the momenta of the bodies of an engine.
+    */
+    void totals(const simulation::engine& sim, double& mass, sf::Vector2<double>& momentum, double& momentum_scale)
+    {
+        mass = 0;
+        momentum = sf::Vector2<double>(0, 0);
+        momentum_scale = 0;
+
+        for(body* b : sim.get_bodies())
+        {
+            sf::Vector2<double> velocity = b -> get_velocity();
+
+            mass += b -> get_mass();
+            momentum += velocity * b -> get_mass();
+            momentum_scale += b -> get_mass() * std::hypot(velocity.x, velocity.y);
+        }
+    }
+}
+
+int main()
+{
+    //a cold disk of small bodies collapsing towards the middle of the window, far from its walls
+    simulation::solver_config config{simulation::solver_type::brute_force};
+    simulation::engine sim{config};
+    sim.set_collision_mode(simulation::collision_mode::merge);
+
+    std::vector<body> initial;
+    simulation::generate(simulation::distribution::cold_collapse, 600, 6e3, 5, initial);
+
+    for(body& b : initial)
+    {
+        sf::Vector2<double> offset = b.get_position() - sf::Vector2<double>(settings::DIMENSIONS.first / 2.0, settings::DIMENSIONS.second / 2.0);
+        sim.add_body(b.get_mass(), 1, false, sf::Vector2<double>(settings::DIMENSIONS.first / 2.0, settings::DIMENSIONS.second / 2.0) + offset * 0.3);
+    }
+
+    double mass_before{};
+    double scale_before{};
+    sf::Vector2<double> momentum_before;
+    totals(sim, mass_before, momentum_before, scale_before);
+
+    size_t merged_steps = 0;
+    for(size_t s = 0; s < 200; ++s)
+    {
+        size_t count = sim.size();
+        sim.step(0.002);
+        merged_steps += sim.size() < count;
+    }
+
+    double mass_after{};
+    double scale_after{};
+    sf::Vector2<double> momentum_after;
+    totals(sim, mass_after, momentum_after, scale_after);
+
+    test::check(merged_steps > 0 && sim.size() < 600, "bodies merged");
+    test::check_close(mass_after, mass_before, 1e-12, "total mass across merges");
+
+    sf::Vector2<double> drift = momentum_after - momentum_before;
+    test::check(std::hypot(drift.x, drift.y) <= 1e-9 * scale_after, "total momentum across merges");
+
+    for(body* b : sim.get_bodies())
+    {
+        sf::Vector2<double> pos = b -> get_position();
+        test::check(pos.x > 1 && pos.y > 1 && pos.x < settings::DIMENSIONS.first - 1 && pos.y < settings::DIMENSIONS.second - 1, "no body reached a wall");
+    }
+
+    //coincident bodies feel no force, rather than both being pushed the same way
+    simulation::engine pair{config};
+    pair.set_collision_mode(simulation::collision_mode::none);
+    pair.add_body(50, 2, false, sf::Vector2<double>(300, 300));
+    pair.add_body(80, 3, false, sf::Vector2<double>(300, 300));
+    pair.step(0.01, 10);
+
+    for(body* b : pair.get_bodies())
+    {
+        test::check(b -> get_position() == sf::Vector2<double>(300, 300), "coincident bodies stay put");
+        test::check(b -> get_velocity() == sf::Vector2<double>(0, 0), "coincident bodies stay at rest");
+    }
+
+    //overlapping bodies attract each other with the clamped force
+    simulation::engine overlap{config};
+    overlap.set_collision_mode(simulation::collision_mode::none);
+    overlap.add_body(50, 2, false, sf::Vector2<double>(300, 300));
+    overlap.add_body(50, 2, false, sf::Vector2<double>(301, 300));
+    overlap.step(0.001);
+
+    const std::vector<body*>& bodies = overlap.get_bodies();
+    test::check_close(bodies[0] -> get_velocity().x, settings::G * 50 / 16 * 0.001, 1e-12, "clamped attraction towards the other body");
+    test::check_close(bodies[1] -> get_velocity().x, -settings::G * 50 / 16 * 0.001, 1e-12, "clamped attraction towards the other body");
+
+    return 0;
+}
@@ -0,0 +1,111 @@
+#include <diagnostics.hpp>
+#include <engine.hpp>
+#include <task_scheduler.hpp>
+#include <initial_conditions.hpp>
+#include <check.hpp>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    /**
+     * @brief Checks that two measurements are equal bit for bit.
+    */
+    void check_same(const simulation::conserved_quantities& value, const simulation::conserved_quantities& expected, const std::string& what)
+    {
+        test::check(value.kinetic == expected.kinetic && value.potential == expected.potential && value.total == expected.total, what + ": energies");
+        test::check(value.momentum == expected.momentum && value.angular_momentum == expected.angular_momentum, what + ": momenta");
+    }
+}
+
+int main()
+{
+    //enough bodies for several reduction blocks
+    std::vector<body> store;
+    simulation::generate(simulation::distribution::exponential_disk, 12000, 1e6, 5, store);
+
+    std::vector<body*> bodies;
+    for(body& b : store)
+    {
+        bodies.push_back(&b);
+    }
+
+    simulation::diagnostics serial{1, ""};
+    simulation::conserved_quantities expected = serial.measure(bodies, 0, 0);
+
+    test::check(serial.energy_drift() == 0, "no drift at the first measurement");
+
+    //the same bodies give the same sums whatever the number of threads
+    for(size_t threads : {1, 2, 3, 4})
+    {
+        simulation::task_scheduler scheduler{threads};
+        simulation::diagnostics parallel{1, ""};
+
+        check_same(parallel.measure(bodies, 0, 0, &scheduler), expected, std::to_string(threads) + " threads");
+        check_same(parallel.measure(bodies, 1, 0, &scheduler), expected, std::to_string(threads) + " threads, repeated");
+        test::check(parallel.energy_drift() == 0, "no drift between identical measurements");
+    }
+
+    //the reductions agree with plain sums over the bodies
+    double kinetic{};
+    sf::Vector2<double> momentum;
+    double angular_momentum{};
+    double momentum_scale{};
+
+    for(body* b : bodies)
+    {
+        sf::Vector2<double> position = b -> get_position();
+        sf::Vector2<double> velocity = b -> get_velocity();
+
+        kinetic += 0.5 * b -> get_mass() * (velocity.x * velocity.x + velocity.y * velocity.y);
+        momentum += velocity * b -> get_mass();
+        angular_momentum += b -> get_mass() * (position.x * velocity.y - position.y * velocity.x);
+        momentum_scale += b -> get_mass() * std::hypot(velocity.x, velocity.y);
+    }
+
+    test::check_close(expected.kinetic, kinetic, 1e-12, "kinetic energy");
+    test::check(std::hypot(expected.momentum.x - momentum.x, expected.momentum.y - momentum.y) <= 1e-12 * momentum_scale, "momentum");
+    test::check_close(expected.angular_momentum, angular_momentum, 1e-12, "angular momentum");
+    test::check(expected.potential < 0, "bound disk has a negative potential energy");
+
+    //measurements taken on demand leave the monitor's reference to the monitor's own first row
+    const std::string path = test::scratch_path("diagnostics_test.csv");
+    {
+        simulation::engine sim{simulation::solver_config{simulation::solver_type::barnes_hut}};
+        sim.set_collision_mode(simulation::collision_mode::none);
+        sim.add_bodies(std::vector<body>(store.begin(), store.begin() + 2000));
+        sim.set_diagnostics(2, path);
+
+        sim.measure();
+        sim.step(0.001);
+        sim.measure();
+        sim.step(0.001, 3);
+    }
+
+    std::ifstream csv{path};
+    std::string header;
+    std::string row;
+    std::getline(csv, header);
+    std::getline(csv, row);
+
+    std::vector<std::string> fields;
+    std::stringstream cells{row};
+    for(std::string cell; std::getline(cells, cell, ',');)
+    {
+        fields.push_back(cell);
+    }
+
+    test::check(header.rfind("step,", 0) == 0 && fields.size() == 9, "diagnostics rows written");
+    test::check(fields[0] == "2" && std::stod(fields[5]) == 0, "first row is the energy reference");
+
+    std::getline(csv, row);
+    test::check(row.rfind("4,", 0) == 0, "rows follow the interval");
+
+    std::remove(path.c_str());
+
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include <force_kernels.hpp>
+#include <body.hpp>
+#include <counter_rng.hpp>
+#include <check.hpp>
+#include <sstream>
+#include <string>
+#include <vector>
+
+int main()
+{
+    const double x = 300;
+    const double y = 300;
+    const double radius = 2;
+
+    //sources spread around the body, some overlapping it and some sitting exactly on it
+    simulation::counter_rng rng{11, 0};
+
+    std::vector<double> xs;
+    std::vector<double> ys;
+    std::vector<double> masses;
+    std::vector<double> radii;
+
+    for(size_t j = 0; j < 67; ++j)
+    {
+        bool coincident = j % 7 == 3;
+        double spread = j % 2 == 0 ? 4 : 200;
+
+        xs.push_back(coincident ? x : x + rng.uniform(-spread, spread));
+        ys.push_back(coincident ? y : y + rng.uniform(-spread, spread));
+        masses.push_back(rng.uniform(1, 100));
+        radii.push_back(rng.uniform(0, 3));
+    }
+
+    test::check(simulation::select_kernels("scalar"), "the scalar kernels are always available");
+    test::check(!simulation::select_kernels("no such kernels"), "unknown kernels are rejected");
+    test::check(std::string{simulation::active_kernels().name} == "scalar", "rejected kernels leave the selection alone");
+
+    std::stringstream names{simulation::available_kernels()};
+    std::string name;
+
+    while(names >> name)
+    {
+        test::check(simulation::select_kernels(name), "available kernels can be selected: " + name);
+        test::check(std::string{simulation::active_kernels().name} == name, "selected kernels are active: " + name);
+
+        //every count up to the full set, so each vector width is checked with every tail length
+        for(size_t count = 0; count <= xs.size(); ++count)
+        {
+            for(bool with_radii : {true, false})
+            {
+                double expected_x{};
+                double expected_y{};
+
+                for(size_t j = 0; j < count; ++j)
+                {
+                    double reach = with_radii ? radius + radii[j] : radius;
+                    sf::Vector2<double> accel = gravity_kernel(xs[j] - x, ys[j] - y, reach, masses[j]);
+
+                    expected_x += accel.x;
+                    expected_y += accel.y;
+                }
+
+                double accel_x = 1;
+                double accel_y = -1;
+
+                simulation::active_kernels().accumulate(x, y, radius, xs.data(), ys.data(), masses.data(), with_radii ? radii.data() : nullptr, count, accel_x, accel_y);
+
+                test::check_close(accel_x - 1, expected_x, 1e-12, name + " kernels match gravity_kernel along x");
+                test::check_close(accel_y + 1, expected_y, 1e-12, name + " kernels match gravity_kernel along y");
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,111 @@
+#include <initial_conditions.hpp>
+#include <settings.hpp>
+#include <check.hpp>
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+namespace
+{
+    /**
+     * @brief Checks that two bodies hold the same state.
+    */
+    void check_same(body& a, body& b, const std::string& what)
+    {
+        test::check(a.get_mass() == b.get_mass(), what + ": mass");
+        test::check(a.get_radius() == b.get_radius(), what + ": radius");
+        test::check(a.is_inplace() == b.is_inplace(), what + ": inplace");
+        test::check(a.get_position() == b.get_position(), what + ": position");
+        test::check(a.get_velocity() == b.get_velocity(), what + ": velocity");
+    }
+}
+
+int main()
+{
+    const std::string csv_path = test::scratch_path("initial_conditions_test.csv");
+    const std::string binary_path = test::scratch_path("initial_conditions_test.bin");
+    const size_t num_records = 5000;
+
+    {
+        std::ofstream csv{csv_path};
+
+        for(size_t i = 0; i < num_records; ++i)
+        {
+            csv << 1.5 + i << ',' << 1 + i % 4 << ',' << (i % 7 == 0) << ',' << 0.25 * i << ',' << 600 - 0.125 * i;
+
+            //velocities are optional
+            if(i % 2 == 0)
+            {
+                csv << ',' << -0.5 * i << ',' << 2.0;
+            }
+            csv << '\n';
+        }
+    }
+
+    std::vector<body> from_csv;
+    simulation::load_csv(csv_path, from_csv);
+
+    test::check(from_csv.size() == num_records, "CSV record count");
+
+    for(size_t i = 0; i < num_records; ++i)
+    {
+        body& b = from_csv[i];
+
+        test::check(b.get_mass() == 1.5 + i, "CSV mass keeps the file order");
+        test::check(b.get_radius() == static_cast<int>(1 + i % 4), "CSV radius");
+        test::check(b.is_inplace() == (i % 7 == 0), "CSV inplace");
+        test::check(b.get_position() == sf::Vector2<double>(0.25 * i, 600 - 0.125 * i), "CSV position");
+        test::check(b.get_velocity() == (i % 2 == 0 ? sf::Vector2<double>(-0.5 * i, 2.0) : sf::Vector2<double>(0, 0)), "CSV velocity");
+    }
+
+    std::vector<body*> pointers;
+    for(body& b : from_csv)
+    {
+        pointers.push_back(&b);
+    }
+
+    simulation::save_binary(binary_path, pointers);
+
+    std::vector<body> from_binary;
+    simulation::load_binary(binary_path, from_binary);
+
+    test::check(from_binary.size() == num_records, "binary record count");
+    for(size_t i = 0; i < num_records; ++i)
+    {
+        check_same(from_binary[i], from_csv[i], "binary round trip");
+    }
+
+    std::remove(csv_path.c_str());
+    std::remove(binary_path.c_str());
+
+    const simulation::distribution kinds[] = {simulation::distribution::plummer, simulation::distribution::exponential_disk, simulation::distribution::cold_collapse};
+
+    for(simulation::distribution kind : kinds)
+    {
+        std::vector<body> first, second, other_seed;
+        simulation::generate(kind, 20000, 1e6, 42, first);
+        simulation::generate(kind, 20000, 1e6, 42, second);
+        simulation::generate(kind, 20000, 1e6, 43, other_seed);
+
+        bool differs = false;
+
+        for(size_t i = 0; i < first.size(); ++i)
+        {
+            check_same(first[i], second[i], "same seed");
+
+            differs = differs || first[i].get_position() != other_seed[i].get_position();
+
+            sf::Vector2<double> pos = first[i].get_position();
+            test::check(pos.x > 0 && pos.y > 0 && pos.x < settings::DIMENSIONS.first && pos.y < settings::DIMENSIONS.second, "generated body inside the window");
+        }
+
+        test::check(differs, "another seed gives other bodies");
+    }
+
+    //appending keeps the bodies already in the store
+    std::vector<body> store(3, body{2, 1, false, sf::Vector2<double>(1, 1)});
+    simulation::generate(simulation::distribution::plummer, 10, 1e6, 42, store);
+    test::check(store.size() == 13 && store[0].get_mass() == 2, "generate appends");
+
+    return 0;
+}
@@ -0,0 +1,96 @@
+#include <interaction_cache.hpp>
+#include <barnes_hut_tree.hpp>
+#include <solver.hpp>
+#include <task_scheduler.hpp>
+#include <initial_conditions.hpp>
+#include <counter_rng.hpp>
+#include <check.hpp>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+    /**
+     * @brief Gets the relative RMS difference between two sets of accelerations.
+    */
+    double relative_error(const std::vector<sf::Vector2<double>>& accels, const std::vector<sf::Vector2<double>>& reference)
+    {
+        double error{};
+        double norm{};
+
+        for(size_t i = 0; i < reference.size(); ++i)
+        {
+            sf::Vector2<double> delta = accels[i] - reference[i];
+            error += delta.x * delta.x + delta.y * delta.y;
+            norm += reference[i].x * reference[i].x + reference[i].y * reference[i].y;
+        }
+
+        return std::sqrt(error / norm);
+    }
+}
+
+int main()
+{
+    const double margin = 4;
+    const double opening_angle = 0.5;
+
+    //every body drifts at unit speed in its own direction, so drift(dt) moves each of them by exactly dt
+    std::vector<body> store;
+    simulation::generate(simulation::distribution::plummer, 4000, 1e6, 7, store);
+
+    simulation::counter_rng rng{7, 1};
+    for(body& b : store)
+    {
+        double angle = rng.uniform(0, 2 * M_PI);
+        b = body{b.get_mass(), b.get_radius(), false, b.get_position(), sf::Vector2<double>(std::cos(angle), std::sin(angle))};
+    }
+
+    std::vector<body*> bodies;
+    for(body& b : store)
+    {
+        bodies.push_back(&b);
+    }
+
+    simulation::task_scheduler scheduler{3};
+    simulation::interaction_cache cache;
+
+    std::vector<sf::Vector2<double>> cached;
+    std::vector<sf::Vector2<double>> walked;
+    std::vector<sf::Vector2<double>> direct;
+
+    cache.compute(bodies, cached, scheduler, opening_angle, 1, margin);
+    test::check(cache.num_rebuilds() == 1 && cache.num_reuses() == 0, "first evaluation builds the lists");
+
+    //up to half the margin, the lists are reused and stay as accurate as a fresh walk at the same opening angle
+    for(int step = 1; step <= 3; ++step)
+    {
+        for(body* b : bodies)
+        {
+            b -> drift(0.16 * margin);
+        }
+
+        cache.compute(bodies, cached, scheduler, opening_angle, 1, margin);
+        test::check(cache.num_rebuilds() == 1 && cache.num_reuses() == static_cast<size_t>(step), "lists reused within half the margin");
+
+        b_h_tree tree{bodies, &scheduler, opening_angle, 1};
+        tree.compute_accels(bodies, walked, &scheduler);
+        simulation::brute_force_accels(bodies, bodies, direct, &scheduler);
+
+        double cached_error = relative_error(cached, direct);
+        double walked_error = relative_error(walked, direct);
+
+        test::check(cached_error <= walked_error, "reused lists as accurate as a fresh walk");
+    }
+
+    //once a body moves further than half the margin the lists are rebuilt
+    bodies.front() -> drift(0.1 * margin);
+
+    cache.compute(bodies, cached, scheduler, opening_angle, 1, margin);
+    test::check(cache.num_rebuilds() == 2 && cache.num_reuses() == 3, "lists rebuilt past half the margin");
+
+    //as they are when the opening angle changes
+    cache.compute(bodies, cached, scheduler, 0.3, 1, margin);
+    test::check(cache.num_rebuilds() == 3, "lists rebuilt for a new opening angle");
+
+    return 0;
+}
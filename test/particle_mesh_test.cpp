@@ -0,0 +1,75 @@
+#include <particle_mesh.hpp>
+#include <solver.hpp>
+#include <task_scheduler.hpp>
+#include <initial_conditions.hpp>
+#include <check.hpp>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+    /**
+     * @brief Gets the relative RMS difference between two sets of accelerations.
+    */
+    double relative_error(const std::vector<sf::Vector2<double>>& accels, const std::vector<sf::Vector2<double>>& reference)
+    {
+        double error{};
+        double norm{};
+
+        for(size_t i = 0; i < reference.size(); ++i)
+        {
+            sf::Vector2<double> delta = accels[i] - reference[i];
+            error += delta.x * delta.x + delta.y * delta.y;
+            norm += reference[i].x * reference[i].x + reference[i].y * reference[i].y;
+        }
+
+        return std::sqrt(error / norm);
+    }
+}
+
+int main()
+{
+    std::vector<body> store;
+    simulation::generate(simulation::distribution::plummer, 4000, 1e6, 3, store);
+
+    std::vector<body*> bodies;
+    for(body& b : store)
+    {
+        bodies.push_back(&b);
+    }
+
+    simulation::task_scheduler serial{1};
+    simulation::task_scheduler threaded{3};
+
+    std::vector<sf::Vector2<double>> reference;
+    simulation::brute_force_accels(bodies, bodies, reference, &threaded);
+
+    double errors[2]{};
+
+    for(bool p3m : {false, true})
+    {
+        simulation::particle_mesh mesh{128, simulation::mass_assignment::tsc, p3m};
+
+        std::vector<sf::Vector2<double>> serial_accels;
+        std::vector<sf::Vector2<double>> threaded_accels;
+        mesh.compute(bodies, serial_accels, serial);
+        mesh.compute(bodies, threaded_accels, threaded);
+
+        test::check(threaded_accels.size() == bodies.size(), "one acceleration per body");
+        test::check(relative_error(threaded_accels, serial_accels) < 1e-9, "same forces on one and three threads");
+
+        errors[p3m] = relative_error(threaded_accels, reference);
+    }
+
+    //the mesh alone softens the force below a cell, P3M sums close pairs directly
+    test::check(errors[0] < 0.5, "PM error against direct summation");
+    test::check(errors[1] < 0.05, "P3M error against direct summation");
+    test::check(errors[1] < errors[0] / 5, "P3M improves on PM");
+
+    simulation::particle_mesh cic{64, simulation::mass_assignment::cic, true};
+    std::vector<sf::Vector2<double>> cic_accels;
+    cic.compute(bodies, cic_accels, threaded);
+    test::check(relative_error(cic_accels, reference) < 0.05, "P3M error with CIC assignment");
+
+    return 0;
+}
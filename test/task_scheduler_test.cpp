@@ -0,0 +1,142 @@
+#include <task_scheduler.hpp>
+#include <check.hpp>
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+    /**
+     * @brief Sums [begin, end) by splitting it in nested task groups down to single elements.
+    */
+    size_t nested_sum(simulation::task_scheduler& scheduler, size_t begin, size_t end)
+    {
+        if(end - begin == 1)
+        {
+            return begin;
+        }
+
+        size_t middle = begin + (end - begin) / 2;
+        size_t left{};
+        size_t right{};
+
+        simulation::task_group group{scheduler};
+        group.spawn([&]() { left = nested_sum(scheduler, begin, middle); });
+        group.spawn([&]() { right = nested_sum(scheduler, middle, end); });
+        group.wait();
+
+        return left + right;
+    }
+}
+
+int main()
+{
+    for(size_t threads : {1, 4})
+    {
+        simulation::task_scheduler scheduler{threads};
+
+        test::check(scheduler.num_threads() == threads, "thread count");
+
+        //every index is visited exactly once
+        std::vector<std::atomic<int>> visits(100000);
+        scheduler.parallel_for(0, visits.size(), 64, [&](size_t block_begin, size_t block_end)
+        {
+            for(size_t i = block_begin; i < block_end; ++i)
+            {
+                ++visits[i];
+            }
+        });
+
+        for(const std::atomic<int>& count : visits)
+        {
+            test::check(count == 1, "parallel_for visits every index once");
+        }
+
+        //a throwing block surfaces on the caller, many times over without leaking work into later calls
+        for(int repeat = 0; repeat < 50; ++repeat)
+        {
+            bool caught = false;
+
+            try
+            {
+                scheduler.parallel_for(0, 100000, 64, [](size_t block_begin, size_t block_end)
+                {
+                    for(size_t i = block_begin; i < block_end; ++i)
+                    {
+                        if(i == 77777)
+                        {
+                            throw std::runtime_error("block failed");
+                        }
+                    }
+                });
+            }
+            catch(const std::runtime_error&)
+            {
+                caught = true;
+            }
+
+            test::check(caught, "parallel_for rethrows a task's exception");
+        }
+
+        //an exception thrown by a task of a nested group reaches the outer wait
+        bool caught = false;
+        try
+        {
+            simulation::task_group outer{scheduler};
+            outer.spawn([&]()
+            {
+                simulation::task_group inner{scheduler};
+                inner.spawn([]() { throw std::logic_error("nested task failed"); });
+                inner.spawn([]() {});
+                inner.wait();
+            });
+            outer.wait();
+        }
+        catch(const std::logic_error&)
+        {
+            caught = true;
+        }
+        test::check(caught, "nested group exception reaches the outer wait");
+
+        //nested groups many levels deep complete and combine their results
+        test::check(nested_sum(scheduler, 0, 4096) == 4096 * 4095 / 2, "nested groups");
+
+        //static blocks run once per worker and cover the range in order
+        std::vector<size_t> owner(10007, threads);
+        scheduler.parallel_for_static(0, owner.size(), [&](size_t block_begin, size_t block_end)
+        {
+            for(size_t i = block_begin; i < block_end; ++i)
+            {
+                owner[i] = block_begin;
+            }
+        });
+
+        for(size_t worker = 0; worker < threads; ++worker)
+        {
+            std::pair<size_t, size_t> block = simulation::static_block(worker, threads, owner.size());
+
+            for(size_t i = block.first; i < block.second; ++i)
+            {
+                test::check(owner[i] == block.first, "static split follows static_block");
+            }
+        }
+
+        std::atomic<size_t> workers{0};
+        scheduler.for_each_worker([&](size_t, size_t num_workers)
+        {
+            test::check(num_workers == threads, "for_each_worker worker count");
+            ++workers;
+        });
+        test::check(workers == threads, "for_each_worker runs once per worker");
+    }
+
+    //a pinned scheduler hands its creator back the cores it had
+    std::vector<int> before = simulation::current_affinity();
+    {
+        simulation::task_scheduler pinned{2, true};
+        test::check(pinned.is_pinned(), "pinned scheduler");
+    }
+    test::check(simulation::current_affinity() == before, "creator affinity restored");
+
+    return 0;
+}
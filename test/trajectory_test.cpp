@@ -0,0 +1,108 @@
+#include <trajectory.hpp>
+#include <check.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+    /**
+     * @brief Checks that a frame holds the positions and radii of the bodies it was recorded from.
+    */
+    void check_frame(const simulation::trajectory_frame& frame, double time, std::vector<body>& bodies, size_t count)
+    {
+        test::check(frame.time == time, "frame time");
+        test::check(frame.num_bodies == count, "frame body count");
+
+        for(size_t i = 0; i < count; ++i)
+        {
+            sf::Vector2<double> pos = bodies[i].get_position();
+
+            test::check(frame.bodies[3 * i] == static_cast<float>(pos.x), "recorded x");
+            test::check(frame.bodies[3 * i + 1] == static_cast<float>(pos.y), "recorded y");
+            test::check(frame.bodies[3 * i + 2] == static_cast<float>(bodies[i].get_radius()), "recorded radius");
+        }
+    }
+}
+
+int main()
+{
+    const std::string path = test::scratch_path("trajectory_test.traj");
+    const size_t num_frames = 100;
+
+    std::vector<body> bodies;
+    for(int i = 0; i < 10; ++i)
+    {
+        bodies.emplace_back(1.0, 1 + i % 3, false, sf::Vector2<double>(10.5 * i, 20.25 * i), sf::Vector2<double>(1, -1));
+    }
+
+    std::vector<body*> pointers;
+    for(body& b : bodies)
+    {
+        pointers.push_back(&b);
+    }
+
+    {
+        simulation::trajectory_writer writer{path, pointers};
+
+        for(size_t f = 0; f < num_frames; ++f)
+        {
+            //bodies merge away halfway through, later frames hold fewer of them
+            std::vector<body*> recorded(pointers.begin(), pointers.begin() + (f < num_frames / 2 ? 10 : 6));
+
+            writer.write_frame(0.5 * f, recorded);
+        }
+    }
+
+    {
+        simulation::trajectory_reader reader{path};
+
+        test::check(reader.num_bodies() == 10, "recorded body count");
+        test::check(reader.num_frames() == num_frames, "recorded frame count");
+
+        check_frame(reader.frame(0), 0, bodies, 10);
+        check_frame(reader.frame(num_frames - 1), 0.5 * (num_frames - 1), bodies, 6);
+
+        test::check(reader.frame_at_time(10.2) == 20, "seek between frames");
+        test::check(reader.frame_at_time(-1) == 0, "seek before the start");
+        test::check(reader.frame_at_time(1e9) == num_frames - 1, "seek past the end");
+
+        bool thrown = false;
+        try
+        {
+            reader.frame(num_frames);
+        }
+        catch(const std::out_of_range&)
+        {
+            thrown = true;
+        }
+        test::check(thrown, "frame past the end throws");
+    }
+
+    //a recording cut short: the header was last refreshed at 64 frames and the last frame is partial
+    {
+        std::fstream file{path, std::ios::binary | std::ios::in | std::ios::out};
+        std::uint64_t refreshed = 64;
+
+        file.seekp(offsetof(simulation::trajectory_header, num_frames));
+        file.write(reinterpret_cast<const char*>(&refreshed), sizeof(refreshed));
+    }
+
+    std::uintmax_t size = std::filesystem::file_size(path);
+    std::filesystem::resize_file(path, size - size / (2 * num_frames));
+
+    {
+        simulation::trajectory_reader reader{path};
+
+        test::check(reader.num_frames() == num_frames - 1, "whole frames of a cut recording");
+        check_frame(reader.frame(num_frames - 2), 0.5 * (num_frames - 2), bodies, 6);
+    }
+
+    std::remove(path.c_str());
+
+    return 0;
+}